@@ -6,6 +6,15 @@ include <iostream>
 #include <algorithm>
 #include <iomanip> // For std::setw
 #include <ctime>   // For time-related functions
+#include <cstdio>  // For rename
+#ifdef _WIN32
+#include <windows.h> // For MoveFileExA
+#include <io.h>      // For _commit
+#include <fcntl.h>
+#else
+#include <fcntl.h>   // For open
+#include <unistd.h>  // For fsync
+#endif
  
 using namespace std;
  
@@ -16,7 +25,8 @@ struct SaleRecord {
     string description;
     string item;
     int quantity;       // Change quantity to int
-    int unit_price;     // Change unit_price to int
+    long long unit_price; // price in cents, so totals are exact
+    int dateKey;        // date packed as YYYYMMDD, filled in by readRecords
 };
  
 // Helper function to validate a date in DD-MM-YYYY format
@@ -33,17 +43,90 @@ bool isValidDate(const string& dateStr) {
     return true;
 }
  
-// Helper function to convert a date from DD-MM-YYYY to YYYYMMDD for sorting
-string sortDate(const string& dateStr) {
-    if (dateStr.size() != 10 || dateStr[2] != '-' || dateStr[5] != '-') {
-        return ""; // Invalid date format
+// Helper function to convert a date from DD-MM-YYYY to a YYYYMMDD number for sorting
+int sortDate(const string& dateStr) {
+    if (!isValidDate(dateStr)) {
+        return 0; // Invalid date format
     }
-    return dateStr.substr(6, 4) + dateStr.substr(3, 2) + dateStr.substr(0, 2);
+    auto digit = [&](size_t i) { return dateStr[i] - '0'; };
+    int year = digit(6) * 1000 + digit(7) * 100 + digit(8) * 10 + digit(9);
+    int month = digit(3) * 10 + digit(4);
+    int day = digit(0) * 10 + digit(1);
+    return year * 10000 + month * 100 + day;
 }
  
 // Helper function to compare two dates
 bool compareDate(const SaleRecord& a, const SaleRecord& b) {
-return sortDate(a.date) < sortDate(b.date);
+return a.dateKey < b.dateKey;
+}
+ 
+// Helper function to convert a price such as "12", "12.5" or "12.34" to cents
+bool parseCents(const string& priceStr, long long& cents) {
+    size_t point = priceStr.find('.');
+    string whole = priceStr.substr(0, point);
+    string fraction = point == string::npos ? "" : priceStr.substr(point + 1);
+    if ((whole.empty() && fraction.empty()) || whole.size() > 15 || fraction.size() > 2) {
+        return false;
+    }
+    for (char c : whole + fraction) {
+        if (!isdigit(static_cast<unsigned char>(c)))
+        return false;
+    }
+    fraction.resize(2, '0');
+    cents = (whole.empty() ? 0 : stoll(whole)) * 100 + stoi(fraction);
+    return true;
+}
+ 
+// Helper function to write cents with two decimals, e.g. 1250 -> "12.50"
+string formatCents(long long cents) {
+    string sign = cents < 0 ? "-" : "";
+    long long magnitude = cents < 0 ? -cents : cents;
+    string fraction = to_string(magnitude % 100);
+    return sign + to_string(magnitude / 100) + "." + (fraction.size() < 2 ? "0" : "") + fraction;
+}
+ 
+// Helper function to force a closed file's contents to disk
+bool syncFile(const string& name) {
+#ifdef _WIN32
+    int fd = _open(name.c_str(), _O_WRONLY);
+    bool synced = fd >= 0 && _commit(fd) == 0;
+    if (fd >= 0) {
+        _close(fd);
+    }
+#else
+    int fd = open(name.c_str(), O_RDONLY);
+    bool synced = fd >= 0 && fsync(fd) == 0;
+    if (fd >= 0) {
+        close(fd);
+    }
+#endif
+    return synced;
+}
+
+// Helper function to put a finished temp file in place of the real one in a
+// single step. The temp file is synced first and the directory after, so a
+// crash never leaves salesnp.csv missing or half written.
+bool replaceFile(const string& from, const string& to) {
+    if (!syncFile(from)) {
+        cerr << "Error: Could not write " << from << "." << endl;
+        remove(from.c_str());
+        return false;
+    }
+#ifdef _WIN32
+    bool replaced = MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    bool replaced = rename(from.c_str(), to.c_str()) == 0;
+#endif
+    if (!replaced) {
+        cerr << "Error: Could not replace " << to << "." << endl;
+        remove(from.c_str());
+    }
+#ifndef _WIN32
+    if (replaced) {
+        syncFile("."); // The rename itself lives in the directory
+    }
+#endif
+    return replaced;
 }
  
 // Function to read all records from the sales.csv file
@@ -60,6 +143,7 @@ getline(ss, record.date, ',');
 if (!isValidDate(record.date)) {
             continue; // Skip invalid date records
         }
+        record.dateKey = sortDate(record.date);
         getline(ss, record.salesid, ',');
         getline(ss, record.description, ',');
         getline(ss, record.item, ',');
@@ -68,16 +152,14 @@ if (!isValidDate(record.date)) {
         getline(ss, quantityStr, ',');
         getline(ss, unitPriceStr, ',');
  
-        // Convert quantity and unit_price to integers
+        // Convert quantity to an integer and unit_price to cents
         try {
             record.quantity = stoi(quantityStr);
         } catch (const invalid_argument&) {
             record.quantity = 0;
         }
  
-        try {
-            record.unit_price = stoi(unitPriceStr);
-        } catch (const invalid_argument&) {
+        if (!parseCents(unitPriceStr, record.unit_price)) {
             record.unit_price = 0;
         }
  
@@ -118,20 +200,20 @@ void copyToTextFile(const vector<SaleRecord>& records) {
             << setw(15) << "SalesAmount" << endl;
     txtFile << "---------------------------------------" << endl;
  
-    int currentSubtotal = 0;
-    int grandTotal = 0;
+    long long currentSubtotal = 0;
+    long long grandTotal = 0;
  
     for (const auto& record : records) {
 if (record.date != currentDate) {
             if (!currentDate.empty()) {
                 txtFile << "---------------------------------------" << endl;
-                txtFile << "SubTotal: " << currentSubtotal << endl;
+                txtFile << "SubTotal: " << formatCents(currentSubtotal) << endl;
                 txtFile << "---------------------------------------" << endl;
             }
 currentDate = record.date;
             currentSubtotal = 0;
         }
-        int salesAmount = record.quantity * record.unit_price;
+        long long salesAmount = record.quantity * record.unit_price;
         currentSubtotal += salesAmount;
         grandTotal += salesAmount;
  
@@ -139,14 +221,14 @@ txtFile << setw(10) << record.date
                 << setw(10) << record.salesid
                 << setw(15) << record.item
                 << setw(10) << record.quantity
-                << setw(10) << record.unit_price
-                << setw(15) << salesAmount << endl;
+                << setw(10) << formatCents(record.unit_price)
+                << setw(15) << formatCents(salesAmount) << endl;
     }
  
     txtFile << "---------------------------------------" << endl;
-    txtFile << "SubTotal: " << currentSubtotal << endl;
+    txtFile << "SubTotal: " << formatCents(currentSubtotal) << endl;
     txtFile << "---------------------------------------" << endl;
-    txtFile << "Grand Total: " << grandTotal << endl;
+    txtFile << "Grand Total: " << formatCents(grandTotal) << endl;
  
     txtFile.close();
 }
@@ -162,7 +244,7 @@ file << record.date << ","
              << record.description << ","
              << record.item << ","
              << record.quantity << ","
-             << record.unit_price << endl;
+             << formatCents(record.unit_price) << endl;
     }
     file.close();
  
@@ -204,7 +286,7 @@ cout << record.date << ","
                  << record.description << ","
                  << record.item << ","
                  << record.quantity << ","
-                 << record.unit_price << endl;
+                 << formatCents(record.unit_price) << endl;
         }
     }
  
@@ -217,8 +299,9 @@ cout << record.date << ","
 // Function to add a new record to the sales.csv file
 void createSale() {
     ofstream file("salesnp.csv", ios::app);
-    string date, salesid, description, item;
-    int quantity, unit_price;
+    string date, salesid, description, item, priceStr;
+    int quantity;
+    long long unit_price;
  
     cout << "Enter Date (DD-MM-YYYY): ";
     cin >> date;
@@ -237,9 +320,13 @@ void createSale() {
     cout << "Enter Quantity: ";
     cin >> quantity;
     cout << "Enter Unit Price: ";
-    cin >> unit_price;
+    cin >> priceStr;
+    while (!parseCents(priceStr, unit_price)) {
+        cout << "Invalid price! Enter Unit Price (e.g. 12.50): ";
+        cin >> priceStr;
+    }
  
-    file << date << "," << salesid << "," << description << "," << item << "," << quantity << "," << unit_price << endl;
+    file << date << "," << salesid << "," << description << "," << item << "," << quantity << "," << formatCents(unit_price) << endl;
     file.close();
  
     sortRecordsByDate(); // Sort the records after adding
@@ -249,9 +336,10 @@ void createSale() {
 // Function to update a record in the sales.csv file
 void updateSale() {
     ifstream file("salesnp.csv");
-    ofstream tempFile("tempnp.csv");
-    string line, salesid, date, description, item;
-    int quantity, unit_price;
+    ofstream tempFile("salesnp.csv.tmp");
+    string line, salesid, date, description, item, priceStr;
+    int quantity;
+    long long unit_price;
  
     cout << "Enter SalesID of the record you want to update: ";
     cin >> salesid;
@@ -280,19 +368,24 @@ void updateSale() {
             cout << "Enter new Quantity: ";
             cin >> quantity;
             cout << "Enter new Unit Price: ";
-            cin >> unit_price;
+            cin >> priceStr;
+            while (!parseCents(priceStr, unit_price)) {
+                cout << "Invalid price! Enter new Unit Price (e.g. 12.50): ";
+                cin >> priceStr;
+            }
  
-            tempFile << date << "," << salesid << "," << description << "," << item << "," << quantity << "," << unit_price << endl;
+            tempFile << date << "," << salesid << "," << description << "," << item << "," << quantity << "," << formatCents(unit_price) << "\n";
         } else {
-            tempFile << line << endl;
+            tempFile << line << "\n";
         }
     }
  
     file.close();
     tempFile.close();
  
-    remove("salesnp.csv");
-    rename("tempnp.csv", "salesnp.csv");
+    if (!tempFile || !replaceFile("salesnp.csv.tmp", "salesnp.csv")) {
+        return;
+    }
  
     sortRecordsByDate(); // Sort the records after updating
  
@@ -305,7 +398,7 @@ void updateSale() {
 // Function to delete a record from the sales.csv file
 void deleteSale() {
     ifstream file("salesnp.csv");
-    ofstream tempFile("tempnp.csv");
+    ofstream tempFile("salesnp.csv.tmp");
     string line, salesid;
  
     cout << "Enter SalesID of the record you want to delete: ";
@@ -322,15 +415,16 @@ void deleteSale() {
             found = true;
             cout << "Record deleted successfully!" << endl;
         } else {
-            tempFile << line << endl;
+            tempFile << line << "\n";
         }
     }
  
     file.close();
     tempFile.close();
  
-    remove("salesnp.csv");
-    rename("tempnp.csv", "salesnp.csv");
+    if (!tempFile || !replaceFile("salesnp.csv.tmp", "salesnp.csv")) {
+        return;
+    }
  
     sortRecordsByDate(); // Sort the records after deleting
  
@@ -4,270 +4,4716 @@
 #include <vector>
 #include <algorithm>
 #include <iomanip>
+#include <unordered_map>
+#include <set>
 #include <map>
+#include <queue>
+#include <random>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
 #include <ctime>
 #include <limits>
+#include <stdexcept>
+#include <string_view>
+#include <charconv>
+#include <memory>
+#include <memory_resource>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include <chrono>
+#include <cstdio>
+#include <cerrno>
+#include <thread>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
 
-// Struct to store sale information
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+// Heap allocation counters, reported by the load benchmark. The operators
+// are kept out of line so the compiler does not pair malloc/free with
+// new/delete expressions at the call sites. Building with -DSALES_NO_STATS
+// keeps the standard operators.
+#ifndef SALES_NO_STATS
+std::atomic<std::size_t> allocationCount{0};
+
+#if defined(__GNUC__)
+#define SALES_NOINLINE __attribute__((noinline))
+#else
+#define SALES_NOINLINE
+#endif
+
+SALES_NOINLINE void* operator new(std::size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size == 0 ? 1 : size)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+SALES_NOINLINE void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+SALES_NOINLINE void operator delete(void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+#endif
+
+// Phases of the program that are timed for --stats
+enum Phase {
+    PhaseLoad,
+    PhaseLoadMapped,
+    PhaseSave,
+    PhaseSortAndSave,
+    PhaseReport,
+    PhaseCreate,
+    PhaseUpdate,
+    PhaseDelete,
+    PhaseQuery,
+    PhaseGroup,
+    PhaseLeaderboard,
+    PhaseLoadPartitions,
+    PhaseCount
+};
+
+const char* const phaseNames[PhaseCount] = {
+    "loadSales", "loadSalesMapped", "saveSales", "sortAndSaveSales",
+    "generateReport", "createSale", "updateSale", "deleteSale", "querySales",
+    "groupSales", "rankSales", "loadPartitions"
+};
+
+// Struct to total the calls, wall time, rows, bytes and heap allocations
+// of one phase over the whole run
+struct PhaseStats {
+    std::size_t calls = 0;
+    double seconds = 0;
+    std::size_t rows = 0;
+    std::size_t bytes = 0;
+    std::size_t allocations = 0;
+};
+
+// Building with -DSALES_NO_STATS removes the timers: the STATS_ macros
+// expand to nothing and their arguments are never evaluated.
+#ifndef SALES_NO_STATS
+PhaseStats phaseStats[PhaseCount];
+
+// Struct to time one call of a phase from construction to end of scope
+struct PhaseTimer {
+    PhaseStats& stats;
+    std::chrono::steady_clock::time_point start;
+    std::size_t allocationsBefore;
+
+    explicit PhaseTimer(Phase phase)
+        : stats(phaseStats[phase]), start(std::chrono::steady_clock::now()),
+          allocationsBefore(allocationCount.load(std::memory_order_relaxed)) {}
+    ~PhaseTimer() {
+        ++stats.calls;
+        stats.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        stats.allocations += allocationCount.load(std::memory_order_relaxed) - allocationsBefore;
+    }
+};
+
+#define STATS_PHASE(phase) PhaseTimer phaseTimer(phase)
+#define STATS_ROWS(count) (phaseTimer.stats.rows += (count))
+#define STATS_BYTES(count) (phaseTimer.stats.bytes += (count))
+#else
+#define STATS_PHASE(phase) ((void)0)
+#define STATS_ROWS(count) ((void)0)
+#define STATS_BYTES(count) ((void)0)
+#endif
+
+// Struct to store sale information. Description and item are codes into
+// the StringDictionary of the store the sale belongs to. Money is held in
+// whole cents so amounts and totals are exact.
 struct Sale {
-    std::string date;
+    int dateKey;        // Packed as YYYYMMDD, see parseDate
     int saleID;
-    std::string description;
-    std::string item;
+    std::uint32_t descriptionCode;
+    std::uint32_t itemCode;
     int quantity;
-    double unitPrice;
+    std::int64_t unitPrice; // Cents, see parsePrice
+
+    std::int64_t salesAmount() const {
+        return quantity * unitPrice;
+    }
+};
+
+// Read-only view of a whole file. Uses mmap, or MapViewOfFile on Windows,
+// and falls back to reading the file into memory if it cannot be mapped.
+class MappedFile {
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::string& filename);
+    ~MappedFile();
+
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool is_open() const { return opened; }
+    std::string_view data() const { return std::string_view(bytes, length); }
+
+private:
+    void release();
+
+    const char* bytes = nullptr;
+    std::size_t length = 0;
+    bool opened = false;
+    bool mapped = false;
+    std::vector<char> buffer; // Fallback storage when the file is not mapped
+};
+
+// Writes a file through a side file that replaces the target only once it
+// is complete and on disk, so a crash leaves either the old or the new file.
+// Text is collected in a large buffer and written in big blocks.
+class AtomicFile {
+public:
+    explicit AtomicFile(const std::string& filename);
+    ~AtomicFile();
+
+    AtomicFile(const AtomicFile&) = delete;
+    AtomicFile& operator=(const AtomicFile&) = delete;
+
+    bool is_open() const { return file != nullptr; }
+    std::string& buffer() { return pending; }
+    void write(std::string_view data);
+    void flushIfFull() {
+        if (pending.size() >= blockSize) {
+            flush();
+        }
+    }
+    // Overwrites bytes already written, e.g. a header completed at the end
+    void writeAt(std::uint64_t offset, std::string_view data);
+    // Flushes, syncs and renames over the target. Without a commit the side
+    // file is removed and the target is left alone.
+    bool commit();
+
+    static const std::size_t blockSize = 1 << 20;
+
+private:
+    void flush();
+
+    std::string target;
+    std::string temporary;
+    std::FILE* file = nullptr;
+    std::string pending;
+    bool failed = false;
+};
+
+// Struct to hold each distinct string once, identified by a dense 32-bit code
+struct StringDictionary {
+    std::vector<std::string_view> strings; // code -> text
+    std::unordered_map<std::string_view, std::uint32_t> codes;
+    // Owned storage for copied strings. Text is packed into large blocks
+    // and released all at once with the dictionary.
+    std::unique_ptr<std::pmr::monotonic_buffer_resource> arena;
+
+    // Returns the code for a string, adding it on first sight. With copyText
+    // false the caller guarantees the text outlives the dictionary.
+    std::uint32_t intern(std::string_view value, bool copyText = true);
+    std::string_view lookup(std::uint32_t code) const { return strings[code]; }
+};
+
+// Struct to hold totals that edits adjust by the difference they make, so
+// summaries never have to go back over the rows
+struct RunningTotals {
+    std::size_t count = 0;
+    std::int64_t quantity = 0;
+    std::int64_t amount = 0;
+
+    void add(const Sale& sale, int sign) {
+        count = sign > 0 ? count + 1 : count - 1;
+        quantity += sign * static_cast<std::int64_t>(sale.quantity);
+        amount += sign * sale.salesAmount();
+    }
+    bool operator==(const RunningTotals& other) const {
+        return count == other.count && quantity == other.quantity && amount == other.amount;
+    }
+};
+
+// Struct to hold the totals of a store per date, per item and overall. A
+// group is dropped once its last sale is gone, so the groups are always the
+// ones a full recompute would find.
+struct SalesAggregates {
+    std::map<int, RunningTotals> dates; // In report order
+    std::unordered_map<std::uint32_t, RunningTotals> items; // By item code
+    RunningTotals total;
+
+    void add(const Sale& sale) {
+        dates[sale.dateKey].add(sale, 1);
+        items[sale.itemCode].add(sale, 1);
+        total.add(sale, 1);
+    }
+    void remove(const Sale& sale);
+};
+
+// Struct to hold a set of sales and the dictionary their text codes refer to
+struct SalesStore {
+    StringDictionary dictionary;
+    std::vector<Sale> rows;
+    std::unordered_map<int, std::size_t> index; // saleID -> position in rows
+    std::set<std::pair<int, int>> byDate; // (dateKey, saleID) in report order
+    SalesAggregates aggregates; // Kept up to date by every edit
+    std::set<int> dirtyMonths; // Months (YYYYMM) edited since their partition was written
+
+    std::size_t size() const { return rows.size(); }
+    const Sale& operator[](std::size_t i) const { return rows[i]; }
+    std::string_view text(std::uint32_t code) const { return dictionary.lookup(code); }
+};
+
+// Struct to walk the sales of a store in date order without copying them
+struct SortedSales {
+    const SalesStore* store;
+    std::vector<std::size_t> order; // Positions in store->rows
+
+    std::size_t size() const { return order.size(); }
+    const Sale& operator[](std::size_t i) const { return store->rows[order[i]]; }
+    std::string_view text(std::uint32_t code) const { return store->text(code); }
+};
+
+// Struct to hold a point-in-time copy of a store for writing out while the
+// store keeps changing. The text views point into the store's dictionary,
+// which only ever grows, so they stay valid for as long as the store lives.
+struct SalesCopy {
+    std::vector<Sale> rows;
+    std::vector<std::string_view> strings;
+    std::vector<std::uint32_t> order; // Positions in rows by (date, sale ID)
+
+    std::size_t size() const { return rows.size(); }
+    const Sale& operator[](std::size_t i) const { return rows[i]; }
+    std::string_view text(std::uint32_t code) const { return strings[code]; }
+};
+
+// Struct to walk a copy in date order
+struct SalesCopyByDate {
+    const SalesCopy* copy;
+
+    std::size_t size() const { return copy->size(); }
+    const Sale& operator[](std::size_t i) const { return copy->rows[copy->order[i]]; }
+    std::string_view text(std::uint32_t code) const { return copy->text(code); }
+};
+
+// Struct to hold sales column by column (structure of arrays). Aggregations
+// only touch the numeric columns they need; text columns are dictionary codes.
+struct ColumnarSales {
+    std::vector<int> dateKeys;
+    std::vector<int> saleIDs;
+    std::vector<int> quantities;
+    std::vector<std::int64_t> unitPrices;
+    std::vector<std::uint32_t> descriptionCodes;
+    std::vector<std::uint32_t> itemCodes;
+    StringDictionary dictionary;
+
+    std::size_t size() const { return saleIDs.size(); }
+    void push_back(const Sale& sale, std::string_view description, std::string_view item);
+
+    // Reassembles one row; its codes refer to this store's dictionary
+    Sale operator[](std::size_t i) const {
+        return Sale{dateKeys[i], saleIDs[i], descriptionCodes[i], itemCodes[i], quantities[i], unitPrices[i]};
+    }
+    std::string_view text(std::uint32_t code) const { return dictionary.lookup(code); }
+};
+
+// Fixed-size header at the start of a binary snapshot. Snapshots are written
+// in host byte order and are a cache of input.csv, not an interchange format.
+struct SnapshotHeader {
+    char magic[8];              // "SALESNAP"
+    std::uint32_t version;
+    std::uint32_t headerSize;
+    std::uint64_t rowCount;
+    std::uint64_t stringCount;
+    std::uint64_t heapBytes;
+    std::uint64_t sourceSize;   // Size and modification time of the CSV the
+    std::int64_t sourceTime;    // snapshot was written alongside
+    std::uint64_t checksum;     // Over everything after the header
+};
+
+const std::uint32_t snapshotVersion = 3; // 2: prices in cents, 3: whole tail checksummed
+
+// Struct to use a binary snapshot in place. The columns are read straight
+// out of the mapped file, in input.csv order, without any parsing.
+struct SnapshotSales {
+    MappedFile file;
+    std::size_t rowCount = 0;
+    std::size_t stringCount = 0;
+    const int* dateKeys = nullptr;
+    const int* saleIDs = nullptr;
+    const std::uint32_t* descriptionCodes = nullptr;
+    const std::uint32_t* itemCodes = nullptr;
+    const int* quantities = nullptr;
+    const std::int64_t* unitPrices = nullptr;
+    const std::uint32_t* dateOrder = nullptr;     // Row positions sorted by (date, sale ID)
+    const std::uint64_t* stringOffsets = nullptr; // stringCount + 1 entries into heap
+    const char* heap = nullptr;
+
+    std::size_t size() const { return rowCount; }
+    Sale operator[](std::size_t i) const {
+        return Sale{dateKeys[i], saleIDs[i], descriptionCodes[i], itemCodes[i], quantities[i], unitPrices[i]};
+    }
+    std::string_view text(std::uint32_t code) const {
+        return std::string_view(heap + stringOffsets[code], stringOffsets[code + 1] - stringOffsets[code]);
+    }
+};
+
+// Struct to view a snapshot in date order using its stored permutation
+struct SnapshotByDate {
+    const SnapshotSales* snapshot;
+
+    std::size_t size() const { return snapshot->size(); }
+    Sale operator[](std::size_t i) const { return (*snapshot)[snapshot->dateOrder[i]]; }
+    std::string_view text(std::uint32_t code) const { return snapshot->text(code); }
+};
+
+// Struct to describe one monthly partition of a partitioned store
+struct PartitionInfo {
+    int month = 0;   // YYYYMM
+    int minDate = 0;
+    int maxDate = 0;
+    std::size_t rows = 0;
+};
+
+// Struct to hold the manifest of a partitioned store: one file of sales per
+// month, each sorted by date and sale ID, listed in manifest.csv as
+// "YYYY-MM,<first date>,<last date>,<rows>"
+struct PartitionManifest {
+    std::string directory;
+    std::map<int, PartitionInfo> partitions; // By month
+};
+
+// Struct to append sale edits to a journal between checkpoints, so an edit
+// costs one short append instead of rewriting input.csv and temp.csv
+// The mutex guards the journal and every change to the store, so a
+// checkpoint can copy the store while edits carry on from another thread.
+// Edits take it exclusively; anything that only reads the store shares it.
+struct SalesJournal {
+    std::string filename;
+    std::ofstream out;
+    std::size_t records = 0; // Records written since the last checkpoint
+    std::chrono::steady_clock::time_point dirtySince; // When the oldest of them was written
+    std::size_t copied = 0; // Records covered by the copy of a running checkpoint
+    std::chrono::steady_clock::time_point tailSince; // When the first record after that copy was written
+    std::size_t checkpoints = 0;
+    PartitionManifest* partitions = nullptr; // Set when checkpoints write monthly partitions
+    std::shared_mutex mutex;
+    std::mutex checkpointMutex; // Held for a whole checkpoint
+};
+
+// Struct to run checkpoints on a background thread, so the menu returns as
+// soon as an edit is journaled. Edits are coalesced until enough of them
+// have collected or the oldest has waited long enough.
+struct WriteBack {
+    SalesStore* store = nullptr;
+    SalesJournal* journal = nullptr;
+    std::thread worker;
+    std::condition_variable_any wake; // Used with journal->mutex
+    bool stopping = false;
+};
+
+// Journals are folded into input.csv in the background once this many edits
+// have collected, or once the oldest edit is this old
+const std::size_t writeBackRecords = 1000;
+const std::chrono::seconds writeBackDelay(5);
+
+// Struct to hold what every connection of the query server shares. Lookups
+// and reports share the journal lock; edits take it on their own.
+struct SalesServer {
+    SalesStore* store = nullptr;
+    SalesJournal* journal = nullptr;
+    WriteBack* writeBack = nullptr;
+    unsigned threadCount = 1; // For each report
+};
+
+// Struct to record which sale IDs have been seen, one bit each in 64k-ID
+// pages. Sequential IDs need about one bit per row.
+struct SeenSaleIDs {
+    static const int pageBits = 16;
+    std::unordered_map<int, std::vector<std::uint64_t>> pages;
+
+    // Returns true the first time an ID is passed in
+    bool insert(int saleID) {
+        std::vector<std::uint64_t>& page = pages[saleID >> pageBits];
+        if (page.empty()) {
+            page.resize((std::size_t(1) << pageBits) / 64);
+        }
+        std::uint32_t bit = static_cast<std::uint32_t>(saleID) & ((1u << pageBits) - 1);
+        std::uint64_t mask = std::uint64_t(1) << (bit % 64);
+        bool first = (page[bit / 64] & mask) == 0;
+        page[bit / 64] |= mask;
+        return first;
+    }
+};
+
+// Struct to record roughly where in a block of text each sale ID first
+// appears: the text is cut into at most 65535 equal blocks and each ID gets
+// the number of its first block, two bytes in 64k-ID pages. Sequential IDs
+// mostly land on the page used last, which is kept at hand.
+struct FirstSaleBlocks {
+    static const int pageBits = 16;
+    int blockBits = 16;
+    std::unordered_map<int, std::vector<std::uint16_t>> pages; // Block + 1, 0 if not seen
+    int lastKey = 0;
+    std::vector<std::uint16_t>* lastPage = nullptr;
+
+    explicit FirstSaleBlocks(std::size_t textSize) {
+        while ((textSize >> blockBits) >= 65535) {
+            ++blockBits;
+        }
+    }
+
+    // Records the block for an ID seen for the first time. Returns the
+    // block + 1 of an earlier line with the ID, or 0.
+    std::uint16_t claim(int saleID, std::size_t offset) {
+        int key = saleID >> pageBits;
+        if (lastPage == nullptr || key != lastKey) {
+            lastPage = &pages[key];
+            lastKey = key;
+            if (lastPage->empty()) {
+                lastPage->resize(std::size_t(1) << pageBits);
+            }
+        }
+        std::uint16_t& entry = (*lastPage)[static_cast<std::uint32_t>(saleID) & ((1u << pageBits) - 1)];
+        std::uint16_t earlier = entry;
+        if (earlier == 0) {
+            entry = static_cast<std::uint16_t>((offset >> blockBits) + 1);
+        }
+        return earlier;
+    }
+};
+
+// Struct to describe the sales a query selects: dates fromDate to toDate,
+// one item name (empty for any item) and a least sales amount in cents
+struct SalesQuery {
+    int fromDate = 0;
+    int toDate = 99991231;
+    std::string item;
+    std::int64_t minAmount = std::numeric_limits<std::int64_t>::min();
+};
+
+// Fields a grouped report can group by. Dates, months and weeks are keyed
+// by number; items and descriptions by their dictionary code.
+enum GroupField {
+    GroupDate,
+    GroupMonth,
+    GroupWeek,
+    GroupItem,
+    GroupDescription
+};
+
+// Aggregates a grouped report can show, as bits of one mask. All but COUNT
+// are shown for both quantity and sales amount.
+enum Measure {
+    MeasureCount = 1,
+    MeasureSum = 2,
+    MeasureMin = 4,
+    MeasureMax = 8,
+    MeasureAvg = 16
+};
+
+// Struct to total the quantities and sales amounts of one group of sales
+struct GroupTotals {
+    std::size_t count = 0;
+    std::int64_t quantity = 0;
+    std::int64_t minQuantity = std::numeric_limits<std::int64_t>::max();
+    std::int64_t maxQuantity = std::numeric_limits<std::int64_t>::min();
+    std::int64_t amount = 0;
+    std::int64_t minAmount = std::numeric_limits<std::int64_t>::max();
+    std::int64_t maxAmount = std::numeric_limits<std::int64_t>::min();
+
+    void add(const Sale& sale) {
+        std::int64_t saleAmount = sale.salesAmount();
+        ++count;
+        quantity += sale.quantity;
+        minQuantity = std::min<std::int64_t>(minQuantity, sale.quantity);
+        maxQuantity = std::max<std::int64_t>(maxQuantity, sale.quantity);
+        amount += saleAmount;
+        minAmount = std::min(minAmount, saleAmount);
+        maxAmount = std::max(maxAmount, saleAmount);
+    }
+
+    void merge(const GroupTotals& other) {
+        count += other.count;
+        quantity += other.quantity;
+        minQuantity = std::min(minQuantity, other.minQuantity);
+        maxQuantity = std::max(maxQuantity, other.maxQuantity);
+        amount += other.amount;
+        minAmount = std::min(minAmount, other.minAmount);
+        maxAmount = std::max(maxAmount, other.maxAmount);
+    }
+};
+
+// Struct to group sales by one or two fields, e.g. item by week. The key of
+// a group packs the fields into one integer, the first in the high half.
+struct Grouping {
+    std::vector<GroupField> fields;
+    std::unordered_map<std::uint64_t, GroupTotals> groups;
+};
+
+// Struct to place one entry on a leaderboard: a sale by its amount or an
+// item by its revenue. Ties go to the lower ID, so rankings never depend on
+// the order entries were seen in.
+struct Ranked {
+    std::int64_t value = 0;
+    std::int64_t id = 0;        // Sale ID or item code
+    std::size_t position = 0;   // Row of a ranked sale
+
+    // True if this entry ranks below the other
+    bool operator<(const Ranked& other) const {
+        return value != other.value ? value < other.value : id > other.id;
+    }
+};
+
+// Struct to keep the limit highest ranked entries seen so far in a min-heap.
+// The lowest kept entry is on top, so an entry that does not make the cut
+// costs one comparison, and memory stays O(limit) however many stream past.
+struct BoundedHeap {
+    std::size_t limit = 0;
+    std::vector<Ranked> entries;
+
+    void push(const Ranked& entry) {
+        auto lower = [](const Ranked& a, const Ranked& b) { return b < a; };
+        if (entries.size() < limit) {
+            entries.push_back(entry);
+            std::push_heap(entries.begin(), entries.end(), lower);
+        } else if (limit > 0 && entries.front() < entry) {
+            std::pop_heap(entries.begin(), entries.end(), lower);
+            entries.back() = entry;
+            std::push_heap(entries.begin(), entries.end(), lower);
+        }
+    }
+
+    void merge(const BoundedHeap& other) {
+        for (const auto& entry : other.entries) {
+            push(entry);
+        }
+    }
+
+    // The kept entries, highest ranked first
+    std::vector<Ranked> ranking() const {
+        std::vector<Ranked> ranked = entries;
+        std::sort(ranked.begin(), ranked.end(), [](const Ranked& a, const Ranked& b) { return b < a; });
+        return ranked;
+    }
+};
+
+struct ReportWriter;
+
+// Function prototypes
+SalesStore loadSales(const std::string& filename);
+SalesStore loadSalesMapped(const std::string& filename, unsigned threadCount = 1);
+bool parseSaleLine(std::string_view line, Sale& sale, StringDictionary& dictionary, bool copyText = true);
+bool parseSaleFields(std::string_view line, Sale& sale, std::string_view& description, std::string_view& item);
+std::size_t parseSaleRows(std::string_view data, std::vector<Sale>& rows, StringDictionary& dictionary, bool copyText = true);
+std::size_t filterSaleRows(std::string_view data, const SalesQuery& query, bool uniqueIDs, std::vector<Sale>& rows,
+                           StringDictionary& dictionary, std::size_t& skipped, std::size_t& duplicates);
+bool readSaleID(std::string_view line, int& saleID);
+void querySales(const std::vector<std::string>& filenames, bool partitions, const SalesQuery& query,
+                const std::string& reportFilename, unsigned threadCount);
+void joinSaleParts(SalesStore& store, const std::vector<std::vector<Sale>>& parts, const std::vector<StringDictionary>& dictionaries);
+bool journalPending(const std::string& filename);
+template <typename Sales> bool writeSalesFile(const std::string& filename, const Sales& sales, std::size_t& bytes);
+template <typename Sales> bool saveSales(const std::string& filename, const Sales& sales);
+template <typename Sales> bool saveSortedSales(const std::string& filename, const Sales& sales);
+template <typename Sales> void displaySales(const Sales& sales);
+int validateIntegerInput(const std::string& prompt);
+std::int64_t validatePriceInput(const std::string& prompt);
+int validateDateInput(const std::string& prompt);
+bool parseDate(std::string_view text, int& dateKey);
+std::string formatDate(int dateKey);
+void formatDate(int dateKey, char* text);
+bool parsePrice(std::string_view text, std::int64_t& cents);
+char* formatPrice(std::int64_t cents, char* text);
+std::string formatPrice(std::int64_t cents);
+void indexSales(SalesStore& store);
+Sale* findSale(SalesStore& store, int saleID);
+bool insertSale(SalesStore& store, const Sale& sale);
+bool eraseSale(SalesStore& store, int saleID);
+void assignSale(SalesStore& store, Sale& target, const Sale& sale);
+SalesAggregates aggregateSales(const std::vector<Sale>& rows);
+bool verifyAggregates(const SalesStore& store);
+bool exerciseAggregates(SalesStore& store, std::size_t editCount, std::uint64_t seed);
+bool groupFromAggregates(const SalesAggregates& aggregates, std::vector<Grouping>& groupings, unsigned measures);
+SortedSales salesByDate(const SalesStore& store);
+void createSale(SalesStore& store, SalesJournal& journal);
+void updateSale(SalesStore& store, SalesJournal& journal);
+void deleteSale(SalesStore& store, SalesJournal& journal);
+void sortAndSaveSales(const SalesStore& store);
+std::string formatSaleLine(const Sale& sale, const SalesStore& store);
+void appendSaleLine(std::string& line, const Sale& sale, std::string_view description, std::string_view item);
+bool sortSalesExternal(const std::string& inputFilename, const std::string& outputFilename, std::size_t memoryBudget);
+bool openJournal(SalesJournal& journal, const std::string& filename);
+void appendJournal(SalesJournal& journal, char kind, const Sale& sale, const SalesStore& store);
+std::size_t replayJournal(SalesStore& store, const std::string& filename);
+bool checkpointSales(SalesStore& store, SalesJournal& journal);
+std::string partitionFilename(const PartitionManifest& manifest, int month);
+std::string partitionJournalFilename(const std::string& directory);
+bool readManifest(PartitionManifest& manifest, const std::string& directory);
+bool writeManifest(const PartitionManifest& manifest);
+bool writePartition(PartitionManifest& manifest, int month, const SalesCopy& sales);
+bool partitionSales(const SalesStore& store, const std::string& directory);
+std::vector<int> overlappingPartitions(const PartitionManifest& manifest, int fromDate, int toDate);
+SalesStore loadPartitions(const PartitionManifest& manifest, int fromDate, int toDate, unsigned threadCount);
+void keepDateRange(SalesStore& store, int fromDate, int toDate);
+SalesCopy copySales(const SalesStore& store);
+void startWriteBack(WriteBack& writeBack, SalesStore& store, SalesJournal& journal);
+void notifyWriteBack(WriteBack& writeBack);
+void stopWriteBack(WriteBack& writeBack);
+void flushOnTerminate(SalesStore& store, SalesJournal& journal);
+std::size_t applyBatch(SalesStore& store, std::string_view data, std::size_t& rejected);
+const char* applyOperation(SalesStore& store, std::string_view line, Sale& applied);
+void runBatch(SalesStore& store, SalesJournal& journal, const std::string& filename);
+std::uint64_t checksumBytes(std::string_view data, std::uint64_t seed);
+bool saveSnapshot(const std::string& filename, const SalesCopy& sales, const std::string& sourceFilename);
+bool openSnapshot(SnapshotSales& snapshot, const std::string& filename, const std::string& sourceFilename);
+SalesStore storeFromSnapshot(const SnapshotSales& snapshot);
+void benchmarkSnapshot(const std::string& filename);
+template <typename Sales> void generateReport(const std::string& reportFilename, const Sales& sales, unsigned threadCount = 1, const SalesAggregates* aggregates = nullptr);
+template <typename Sales> void writeReport(ReportWriter& out, const Sales& sales, unsigned threadCount, const SalesAggregates* aggregates = nullptr);
+template <typename Sales> void formatReportRows(const Sales& sales, std::size_t begin, std::size_t end, ReportWriter& out, std::vector<std::pair<int, std::int64_t>>* subtotals);
+template <typename Sales> std::int64_t accumulateTotals(const Sales& sales, std::vector<std::pair<int, std::int64_t>>& subtotals);
+std::int64_t accumulateTotals(const ColumnarSales& sales, std::vector<std::pair<int, std::int64_t>>& subtotals);
+template <typename Sales> ColumnarSales toColumnar(const Sales& sales);
+void benchmarkColumnar(const std::string& filename);
+void benchmarkLoad(const std::string& filename, unsigned threadCount);
+void benchmarkEdits();
+void generateSales(const std::string& filename, std::size_t rowCount, std::uint64_t seed);
+void benchmarkPipeline(const std::vector<std::size_t>& sizes, std::uint64_t seed);
+void printStats();
+int daysFromDate(int dateKey);
+int dateFromDays(int days);
+bool parseGrouping(std::string_view spec, Grouping& grouping);
+bool parseMeasures(std::string_view spec, unsigned& measures);
+std::uint32_t groupKeyPart(GroupField field, const Sale& sale);
+template <typename Sales> void groupSales(const Sales& sales, std::vector<Grouping>& groupings);
+template <typename Sales> void writeGroupReport(ReportWriter& out, const Grouping& grouping, const Sales& sales, unsigned measures);
+template <typename Sales> void generateGroupReport(const std::string& reportFilename, const Sales& sales, std::vector<Grouping>& groupings, unsigned measures);
+std::string currentDate();
+template <typename Sales> void generateLeaderboard(const std::string& reportFilename, const Sales& sales, std::size_t itemLimit,
+                                                   std::size_t saleLimit, unsigned threadCount, const SalesAggregates* aggregates = nullptr);
+SalesCopy copySalesRange(const SalesStore& store, int fromDate, int toDate);
+std::string handleRequest(SalesServer& server, std::string_view request);
+void serveSales(SalesServer& server, const std::string& socketPath);
+void serveConnection(SalesServer& server, int connection);
+void loadTestServer(const std::string& socketPath, std::size_t requestCount, unsigned clientCount, std::uint64_t seed);
+
+// Struct to collect report text in one large buffer that goes to the file
+// in big blocks, instead of one formatted stream insertion per field
+struct ReportWriter {
+    std::ofstream* file = nullptr; // Null for a writer that only collects text
+    std::string buffer;
+
+    ReportWriter() = default;
+    explicit ReportWriter(std::ofstream& target) : file(&target) {
+        buffer.reserve(blockSize + 4096);
+    }
+
+    // Appends text left-aligned in a field of the given width, like
+    // std::left << std::setw(width)
+    void text(std::string_view value, std::size_t width = 0) {
+        buffer.append(value);
+        if (value.size() < width) {
+            buffer.append(width - value.size(), ' ');
+        }
+    }
+
+    void number(long long value, std::size_t width) {
+        char digits[24];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        text(std::string_view(digits, static_cast<std::size_t>(result.ptr - digits)), width);
+    }
+
+    // Cents with exactly two decimals, e.g. 150 -> "1.50"
+    void money(std::int64_t cents, std::size_t width) {
+        char digits[32];
+        char* end = digits;
+        std::uint64_t magnitude = cents < 0 ? 0 - static_cast<std::uint64_t>(cents) : static_cast<std::uint64_t>(cents);
+        if (cents < 0) {
+            *end++ = '-';
+        }
+        end = std::to_chars(end, digits + sizeof(digits), magnitude / 100).ptr;
+        *end++ = '.';
+        *end++ = static_cast<char>('0' + magnitude % 100 / 10);
+        *end++ = static_cast<char>('0' + magnitude % 10);
+        text(std::string_view(digits, static_cast<std::size_t>(end - digits)), width);
+    }
+
+    void date(int dateKey, std::size_t width) {
+        char digits[10];
+        formatDate(dateKey, digits);
+        text(std::string_view(digits, sizeof(digits)), width);
+    }
+
+    void flushIfFull() {
+        if (buffer.size() >= blockSize) {
+            flush();
+        }
+    }
+
+    void flush() {
+        if (file != nullptr) {
+            file->write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            buffer.clear();
+        }
+    }
+
+    // Adds text that was collected by another writer. A file writer passes
+    // it straight through instead of copying it into its buffer.
+    void block(const std::string& text) {
+        if (file != nullptr) {
+            flush();
+            file->write(text.data(), static_cast<std::streamsize>(text.size()));
+        } else {
+            buffer.append(text);
+        }
+    }
+
+    static const std::size_t blockSize = 1 << 20;
+};
+
+MappedFile::MappedFile(const std::string& filename) {
+#ifndef _WIN32
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    struct stat info;
+    if (::fstat(fd, &info) == 0) {
+        length = static_cast<std::size_t>(info.st_size);
+        if (length == 0) {
+            opened = true;
+        } else {
+            void* address = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (address != MAP_FAILED) {
+                ::madvise(address, length, MADV_SEQUENTIAL);
+                bytes = static_cast<const char*>(address);
+                opened = true;
+                mapped = true;
+            }
+        }
+    }
+    ::close(fd);
+#else
+    HANDLE handle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(handle, &size)
+        && static_cast<std::uint64_t>(size.QuadPart) <= std::numeric_limits<std::size_t>::max()) {
+        length = static_cast<std::size_t>(size.QuadPart);
+        if (length == 0) {
+            opened = true; // An empty file cannot be mapped
+        } else {
+            // The view keeps the file open once both handles are closed
+            HANDLE mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping != nullptr) {
+                void* address = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                if (address != nullptr) {
+                    bytes = static_cast<const char*>(address);
+                    opened = true;
+                    mapped = true;
+                }
+                CloseHandle(mapping);
+            }
+        }
+    }
+    CloseHandle(handle);
+#endif
+    if (opened) {
+        return;
+    }
+    length = 0;
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        return;
+    }
+    buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    bytes = buffer.data();
+    length = buffer.size();
+    opened = true;
+}
+
+MappedFile::~MappedFile() {
+    release();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : bytes(other.bytes), length(other.length), opened(other.opened),
+      mapped(other.mapped), buffer(std::move(other.buffer)) {
+    other.bytes = nullptr;
+    other.length = 0;
+    other.opened = false;
+    other.mapped = false;
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        release();
+        bytes = other.bytes;
+        length = other.length;
+        opened = other.opened;
+        mapped = other.mapped;
+        buffer = std::move(other.buffer);
+        other.bytes = nullptr;
+        other.length = 0;
+        other.opened = false;
+        other.mapped = false;
+    }
+    return *this;
+}
+
+void MappedFile::release() {
+    if (mapped) {
+#ifdef _WIN32
+        UnmapViewOfFile(bytes);
+#else
+        ::munmap(const_cast<char*>(bytes), length);
+#endif
+    }
+    bytes = nullptr;
+    length = 0;
+    opened = false;
+    mapped = false;
+    buffer.clear();
+}
+
+AtomicFile::AtomicFile(const std::string& filename)
+    : target(filename), temporary(filename + ".tmp") {
+    file = std::fopen(temporary.c_str(), "wb");
+    if (file != nullptr) {
+        std::setvbuf(file, nullptr, _IONBF, 0); // Blocks go straight to write()
+        pending.reserve(blockSize + 4096);
+    }
+}
+
+AtomicFile::~AtomicFile() {
+    if (file != nullptr) {
+        std::fclose(file);
+        std::remove(temporary.c_str());
+    }
+}
+
+void AtomicFile::write(std::string_view data) {
+    pending.append(data);
+    flushIfFull();
+}
+
+void AtomicFile::flush() {
+    if (!pending.empty() && std::fwrite(pending.data(), 1, pending.size(), file) != pending.size()) {
+        failed = true;
+    }
+    pending.clear();
+}
+
+void AtomicFile::writeAt(std::uint64_t offset, std::string_view data) {
+    flush();
+    if (std::fseek(file, static_cast<long>(offset), SEEK_SET) != 0
+        || std::fwrite(data.data(), 1, data.size(), file) != data.size()
+        || std::fseek(file, 0, SEEK_END) != 0) {
+        failed = true;
+    }
+}
+
+bool AtomicFile::commit() {
+    if (file == nullptr) {
+        return false;
+    }
+    flush();
+    failed |= std::fflush(file) != 0;
+    // The data must be on disk before the rename; a write-through rename
+    // alone does not flush the file it moves
+#ifdef _WIN32
+    failed |= ::_commit(::_fileno(file)) != 0;
+#else
+    failed |= ::fsync(::fileno(file)) != 0;
+#endif
+    failed |= std::fclose(file) != 0;
+    file = nullptr;
+    if (failed) {
+        std::cerr << "Error: Could not write file " << target << ".\n";
+        std::remove(temporary.c_str());
+        return false;
+    }
+
+#ifdef _WIN32
+    bool replaced = MoveFileExA(temporary.c_str(), target.c_str(),
+                                MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    bool replaced = std::rename(temporary.c_str(), target.c_str()) == 0;
+#endif
+    if (!replaced) {
+        std::cerr << "Error: Could not replace file " << target << ".\n";
+        std::remove(temporary.c_str());
+        return false;
+    }
+
+#ifndef _WIN32
+    // Sync the directory too, so the rename itself survives a crash
+    std::string directory = std::filesystem::path(target).parent_path().string();
+    int fd = ::open(directory.empty() ? "." : directory.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        ::fsync(fd);
+        ::close(fd);
+    }
+#endif
+    return true;
+}
+
+// Function to validate integer input
+int validateIntegerInput(const std::string& prompt) {
+    int value;
+    while (true) {
+        std::cout << prompt;
+        std::cin >> value;
+        if (std::cin.fail() || value < 0) {
+            std::cin.clear(); // Clear the error flag
+            std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n'); // Ignore the invalid input
+            std::cerr << "Invalid input. Please enter a positive integer.\n";
+        } else {
+            std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n'); // Ignore any extra input
+            return value;
+        }
+    }
+}
+
+// Function to validate price input, returned in cents
+std::int64_t validatePriceInput(const std::string& prompt) {
+    std::string value;
+    std::int64_t cents;
+    while (true) {
+        std::cout << prompt;
+        std::cin >> value;
+        if (std::cin.fail() || !parsePrice(value, cents) || cents < 0) {
+            std::cin.clear(); // Clear the error flag
+            std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n'); // Ignore the invalid input
+            std::cerr << "Invalid input. Please enter a positive amount with at most two decimals.\n";
+        } else {
+            std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n'); // Ignore any extra input
+            return cents;
+        }
+    }
+}
+
+// Function to validate date input
+int validateDateInput(const std::string& prompt) {
+    std::string value;
+    int dateKey;
+    while (true) {
+        std::cout << prompt;
+        std::cin >> value;
+        if (std::cin.fail() || !parseDate(value, dateKey)) {
+            std::cin.clear(); // Clear the error flag
+            std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n'); // Ignore the invalid input
+            std::cerr << "Invalid date. Please enter YYYY-MM-DD or DD-MM-YYYY.\n";
+        } else {
+            return dateKey;
+        }
+    }
+}
+
+// Function to turn a date written as YYYY-MM-DD or DD-MM-YYYY into a packed
+// YYYYMMDD integer, which orders the same way as the dates themselves.
+// Dates are parsed once on the way in and only turned back into text for output.
+bool parseDate(std::string_view text, int& dateKey) {
+    if (text.size() != 10) {
+        return false;
+    }
+
+    auto digits = [&](std::size_t pos, std::size_t count, int& value) {
+        value = 0;
+        for (std::size_t i = pos; i < pos + count; ++i) {
+            if (text[i] < '0' || text[i] > '9') {
+                return false;
+            }
+            value = value * 10 + (text[i] - '0');
+        }
+        return true;
+    };
+
+    int year, month, day;
+    if (text[4] == '-' && text[7] == '-') {
+        if (!digits(0, 4, year) || !digits(5, 2, month) || !digits(8, 2, day)) {
+            return false;
+        }
+    } else if (text[2] == '-' && text[5] == '-') {
+        if (!digits(0, 2, day) || !digits(3, 2, month) || !digits(6, 4, year)) {
+            return false;
+        }
+    } else {
+        return false;
+    }
+
+    static const int daysInMonth[] = {31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    if (month < 1 || month > 12 || day < 1 || day > daysInMonth[month - 1]) {
+        return false;
+    }
+    bool leapYear = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    if (month == 2 && day == 29 && !leapYear) {
+        return false;
+    }
+
+    dateKey = year * 10000 + month * 100 + day;
+    return true;
+}
+
+// Function to turn a packed date key back into YYYY-MM-DD text
+std::string formatDate(int dateKey) {
+    char text[10];
+    formatDate(dateKey, text);
+    return std::string(text, 10);
+}
+
+// Function to write a packed date key as the 10 characters YYYY-MM-DD
+void formatDate(int dateKey, char* text) {
+    int year = dateKey / 10000;
+    int month = dateKey / 100 % 100;
+    int day = dateKey % 100;
+    text[0] = static_cast<char>('0' + year / 1000 % 10);
+    text[1] = static_cast<char>('0' + year / 100 % 10);
+    text[2] = static_cast<char>('0' + year / 10 % 10);
+    text[3] = static_cast<char>('0' + year % 10);
+    text[4] = '-';
+    text[5] = static_cast<char>('0' + month / 10);
+    text[6] = static_cast<char>('0' + month % 10);
+    text[7] = '-';
+    text[8] = static_cast<char>('0' + day / 10);
+    text[9] = static_cast<char>('0' + day % 10);
+}
+
+// Function to parse a decimal amount such as "12", "12.5" or "-0.25" into
+// cents. Digits past the second decimal are rounded half away from zero.
+bool parsePrice(std::string_view text, std::int64_t& cents) {
+    bool negative = !text.empty() && text[0] == '-';
+    if (negative) {
+        text.remove_prefix(1);
+    }
+
+    std::size_t point = text.find('.');
+    std::string_view whole = text.substr(0, point);
+    std::string_view fraction = point == std::string_view::npos ? std::string_view() : text.substr(point + 1);
+    if ((whole.empty() && fraction.empty()) || whole.size() > 15) {
+        return false;
+    }
+    // Only digits either side of the point; from_chars alone would take a
+    // second sign in the whole part
+    for (std::string_view part : {whole, fraction}) {
+        for (char c : part) {
+            if (c < '0' || c > '9') {
+                return false;
+            }
+        }
+    }
+
+    std::int64_t units = 0;
+    if (!whole.empty()) {
+        auto result = std::from_chars(whole.data(), whole.data() + whole.size(), units);
+        if (result.ec != std::errc() || result.ptr != whole.data() + whole.size()) {
+            return false;
+        }
+    }
+    int tenths = fraction.size() > 0 ? fraction[0] - '0' : 0;
+    int hundredths = fraction.size() > 1 ? fraction[1] - '0' : 0;
+    int round = fraction.size() > 2 && fraction[2] >= '5' ? 1 : 0;
+
+    cents = units * 100 + tenths * 10 + hundredths + round;
+    if (negative) {
+        cents = -cents;
+    }
+    return true;
+}
+
+// Function to write cents in the shortest decimal form: 500 -> "5",
+// 1250 -> "12.5", 1234 -> "12.34". Returns the end of the text.
+char* formatPrice(std::int64_t cents, char* text) {
+    std::uint64_t magnitude = cents < 0 ? 0 - static_cast<std::uint64_t>(cents) : static_cast<std::uint64_t>(cents);
+    if (cents < 0) {
+        *text++ = '-';
+    }
+    text = std::to_chars(text, text + 24, magnitude / 100).ptr;
+    int fraction = static_cast<int>(magnitude % 100);
+    if (fraction != 0) {
+        *text++ = '.';
+        *text++ = static_cast<char>('0' + fraction / 10);
+        if (fraction % 10 != 0) {
+            *text++ = static_cast<char>('0' + fraction % 10);
+        }
+    }
+    return text;
+}
+
+std::string formatPrice(std::int64_t cents) {
+    char text[32];
+    return std::string(text, formatPrice(cents, text));
+}
+
+// Function to load sales from the CSV file into a store
+SalesStore loadSales(const std::string& filename) {
+    STATS_PHASE(PhaseLoad);
+    SalesStore store;
+    std::ifstream file(filename);
+
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not open file " << filename << ".\n";
+        return store;
+    }
+
+    // One line buffer is reused for the whole file and fields are split in
+    // place, so the only allocations are for rows and new dictionary text
+    std::string line;
+    std::size_t skipped = 0;
+    while (std::getline(file, line)) {
+        STATS_BYTES(line.size() + 1);
+        if (line.empty() || line == "\r") {
+            continue;
+        }
+        Sale sale;
+        if (parseSaleLine(line, sale, store.dictionary)) {
+            store.rows.push_back(sale);
+        } else {
+            ++skipped;
+        }
+    }
+
+    if (skipped > 0) {
+        std::cerr << "Warning: Skipped " << skipped << " malformed row(s) in " << filename << ".\n";
+    }
+    STATS_ROWS(store.rows.size());
+    file.close();
+    return store;
+}
+
+// Function to split one CSV line into a sale, interning its text fields.
+// Returns false if the line does not hold six well-formed fields.
+bool parseSaleLine(std::string_view line, Sale& sale, StringDictionary& dictionary, bool copyText) {
+    std::string_view description;
+    std::string_view item;
+    if (!parseSaleFields(line, sale, description, item)) {
+        return false;
+    }
+    sale.descriptionCode = dictionary.intern(description, copyText);
+    sale.itemCode = dictionary.intern(item, copyText);
+    return true;
+}
+
+// Function to split one CSV line into the numeric fields of a sale and views
+// of its description and item text
+bool parseSaleFields(std::string_view line, Sale& sale, std::string_view& description, std::string_view& item) {
+    if (!line.empty() && line.back() == '\r') {
+        line.remove_suffix(1);
+    }
+
+    std::string_view fields[6];
+    for (int i = 0; i < 5; ++i) {
+        std::size_t comma = line.find(',');
+        if (comma == std::string_view::npos) {
+            return false;
+        }
+        fields[i] = line.substr(0, comma);
+        line.remove_prefix(comma + 1);
+    }
+    fields[5] = line;
+
+    auto toNumber = [](std::string_view field, auto& value) {
+        const char* end = field.data() + field.size();
+        auto result = std::from_chars(field.data(), end, value);
+        return result.ec == std::errc() && result.ptr == end;
+    };
+
+    if (!parseDate(fields[0], sale.dateKey)
+        || !toNumber(fields[1], sale.saleID)
+        || !toNumber(fields[4], sale.quantity)
+        || !parsePrice(fields[5], sale.unitPrice)) {
+        return false;
+    }
+    description = fields[2];
+    item = fields[3];
+    return true;
+}
+
+// Function to parse every line of a block of CSV text into rows.
+// Returns the number of malformed lines that were skipped.
+std::size_t parseSaleRows(std::string_view data, std::vector<Sale>& rows, StringDictionary& dictionary, bool copyText) {
+    rows.reserve(rows.size() + static_cast<std::size_t>(std::count(data.begin(), data.end(), '\n')) + 1);
+
+    std::size_t skipped = 0;
+    while (!data.empty()) {
+        std::size_t newline = data.find('\n');
+        std::string_view line = data.substr(0, newline);
+        data.remove_prefix(newline == std::string_view::npos ? data.size() : newline + 1);
+
+        if (line.empty() || line == "\r") {
+            continue;
+        }
+        Sale sale;
+        if (parseSaleLine(line, sale, dictionary, copyText)) {
+            rows.push_back(sale);
+        } else {
+            ++skipped;
+        }
+    }
+    return skipped;
+}
+
+// Function to append rows parsed separately to a store, in order. Each part
+// has its own dictionary; its codes are translated to the store's, which
+// copies the text, so the parts' sources can go once this returns.
+void joinSaleParts(SalesStore& store, const std::vector<std::vector<Sale>>& parts, const std::vector<StringDictionary>& dictionaries) {
+    std::size_t total = store.rows.size();
+    for (const auto& part : parts) {
+        total += part.size();
+    }
+    store.rows.reserve(total);
+    for (std::size_t i = 0; i < parts.size(); ++i) {
+        std::vector<std::uint32_t> codes;
+        codes.reserve(dictionaries[i].strings.size());
+        for (auto text : dictionaries[i].strings) {
+            codes.push_back(store.dictionary.intern(text));
+        }
+        for (auto sale : parts[i]) {
+            sale.descriptionCode = codes[sale.descriptionCode];
+            sale.itemCode = codes[sale.itemCode];
+            store.rows.push_back(sale);
+        }
+    }
+}
+
+// Function to pick out the lines of a block of CSV text that match a query.
+// The predicates are tested on the raw bytes, cheapest first: the date text
+// against the range (YYYY-MM-DD text sorts like the date itself), then the
+// item name, and only then are the numbers converted for the amount. A line
+// that fails is passed over without copying anything. Text of matching
+// lines is not copied, so data must outlive the dictionary.
+// As when loading, a match is dropped if an earlier well-formed line has
+// the same sale ID. Unless uniqueIDs says the data cannot repeat an ID, as
+// with partition files, each line's ID is read and the block of text it
+// first appeared in is noted before the predicates; that costs a number
+// conversion per line. A match whose ID was noted before is settled after
+// the scan by finding and parsing the line in that block that first had
+// it, and only if that line is malformed by looking through the whole text
+// for the next one. Returns the number of lines scanned; skipped
+// counts malformed matches and duplicates the dropped matches.
+std::size_t filterSaleRows(std::string_view data, const SalesQuery& query, bool uniqueIDs, std::vector<Sale>& rows,
+                           StringDictionary& dictionary, std::size_t& skipped, std::size_t& duplicates) {
+    char fromText[10];
+    char toText[10];
+    formatDate(query.fromDate, fromText);
+    formatDate(query.toDate, toText);
+
+    const char* cursor = data.data();
+    const char* end = cursor + data.size();
+    std::size_t scanned = 0;
+    skipped = 0;
+    duplicates = 0;
+    FirstSaleBlocks firstSeen(data.size());
+    // Matches whose ID an earlier line had: position in rows and line start
+    std::vector<std::pair<std::size_t, const char*>> contested;
+    std::vector<std::uint16_t> earlierBlocks; // Block + 1 of the first line for each
+    std::size_t firstRow = rows.size();
+    while (cursor < end) {
+        const char* newline = static_cast<const char*>(std::memchr(cursor, '\n', static_cast<std::size_t>(end - cursor)));
+        std::string_view line(cursor, static_cast<std::size_t>((newline ? newline : end) - cursor));
+        cursor = newline ? newline + 1 : end;
+        if (line.empty() || line == "\r") {
+            continue;
+        }
+        ++scanned;
+
+        int lineID;
+        std::uint16_t earlier = 0;
+        if (!uniqueIDs && readSaleID(line, lineID)) {
+            earlier = firstSeen.claim(lineID, static_cast<std::size_t>(line.data() - data.data()));
+        }
+
+        if (line.size() > 10 && line[4] == '-' && line[7] == '-' && line[10] == ',') {
+            if (std::memcmp(line.data(), fromText, 10) < 0 || std::memcmp(line.data(), toText, 10) > 0) {
+                continue;
+            }
+        } else {
+            // DD-MM-YYYY does not sort as text, so those dates are parsed
+            int dateKey;
+            if (!parseDate(line.substr(0, line.find(',')), dateKey) || dateKey < query.fromDate || dateKey > query.toDate) {
+                continue;
+            }
+        }
+
+        if (!query.item.empty()) {
+            std::size_t start = 0;
+            for (int field = 0; field < 3 && start != std::string_view::npos; ++field) {
+                std::size_t comma = line.find(',', start);
+                start = comma == std::string_view::npos ? comma : comma + 1;
+            }
+            if (start == std::string_view::npos || line.substr(start, line.find(',', start) - start) != query.item) {
+                continue;
+            }
+        }
+
+        Sale sale;
+        std::string_view description;
+        std::string_view item;
+        if (!parseSaleFields(line, sale, description, item)) {
+            ++skipped;
+            continue;
+        }
+        if (sale.salesAmount() < query.minAmount) {
+            continue;
+        }
+        sale.descriptionCode = dictionary.intern(description, false);
+        sale.itemCode = dictionary.intern(item, false);
+        if (earlier != 0) {
+            contested.emplace_back(rows.size(), line.data());
+            earlierBlocks.push_back(earlier);
+        }
+        rows.push_back(sale);
+    }
+
+    auto lineAt = [&](const char* start) {
+        const char* newline = static_cast<const char*>(std::memchr(start, '\n', static_cast<std::size_t>(end - start)));
+        return std::string_view(start, static_cast<std::size_t>((newline ? newline : end) - start));
+    };
+    // The first well-formed line for each contested ID; a match that is not
+    // that line is a later duplicate. Usually the line that first had the ID
+    // will do; IDs whose first line is malformed are looked for in full.
+    std::unordered_map<int, const char*> firstLines;
+    std::size_t unsettled = 0;
+    for (std::size_t i = 0; i < contested.size(); ++i) {
+        int saleID = rows[contested[i].first].saleID;
+        if (firstLines.count(saleID)) {
+            continue;
+        }
+        // Lines starting in the block, from the end of the one before it
+        std::size_t blockStart = std::size_t(earlierBlocks[i] - 1) << firstSeen.blockBits;
+        const char* blockEnd = data.data() + std::min(data.size(), blockStart + (std::size_t(1) << firstSeen.blockBits));
+        const char* start = data.data() + blockStart;
+        while (start > data.data() && start[-1] != '\n') {
+            --start;
+        }
+        std::string_view line;
+        int lineID = 0;
+        for (; start < blockEnd; start = line.data() + line.size() + 1) {
+            line = lineAt(start);
+            if (readSaleID(line, lineID) && lineID == saleID) {
+                break;
+            }
+        }
+        Sale sale;
+        std::string_view description;
+        std::string_view item;
+        if (start < blockEnd && parseSaleFields(line, sale, description, item)) {
+            firstLines.emplace(saleID, start);
+        } else {
+            firstLines.emplace(saleID, nullptr);
+            ++unsettled;
+        }
+    }
+    if (!contested.empty()) {
+        for (cursor = data.data(); cursor < end && unsettled > 0;) {
+            std::string_view line = lineAt(cursor);
+            cursor = line.data() + line.size() + 1;
+            int lineID;
+            if (!readSaleID(line, lineID)) {
+                continue;
+            }
+            auto found = firstLines.find(lineID);
+            Sale sale;
+            std::string_view description;
+            std::string_view item;
+            if (found != firstLines.end() && found->second == nullptr && parseSaleFields(line, sale, description, item)) {
+                found->second = line.data();
+                --unsettled;
+            }
+        }
+        std::vector<bool> dropped(rows.size() - firstRow, false);
+        for (const auto& [position, start] : contested) {
+            if (firstLines[rows[position].saleID] != start) {
+                dropped[position - firstRow] = true;
+                ++duplicates;
+            }
+        }
+        std::size_t kept = firstRow;
+        for (std::size_t i = firstRow; i < rows.size(); ++i) {
+            if (!dropped[i - firstRow]) {
+                rows[kept++] = rows[i];
+            }
+        }
+        rows.resize(kept);
+    }
+    return scanned;
+}
+
+// Function to read the sale ID, the second field, of a CSV line. Lines
+// with a YYYY-MM-DD date have the ID at a known place and take a short cut.
+bool readSaleID(std::string_view line, int& saleID) {
+    if (line.size() > 11 && line[10] == ',') {
+        const char* digit = line.data() + 11;
+        const char* end = line.data() + line.size();
+        int value = 0;
+        int digits = 0;
+        for (; digit < end && static_cast<unsigned>(*digit - '0') < 10 && digits < 9; ++digit, ++digits) {
+            value = value * 10 + (*digit - '0');
+        }
+        if (digits > 0 && digit < end && *digit == ',') {
+            saleID = value;
+            return true;
+        }
+    }
+    std::size_t comma = line.find(',');
+    if (comma == std::string_view::npos) {
+        return false;
+    }
+    const char* end = line.data() + line.size();
+    auto result = std::from_chars(line.data() + comma + 1, end, saleID);
+    return result.ec == std::errc() && result.ptr != end && *result.ptr == ',';
+}
+
+// Function to write the report for only the sales that match a query,
+// straight from the mapped CSV files. The store is never loaded; rows that
+// do not match are only scanned, plus a read of their sale ID unless the
+// files are partitions, whose IDs are unique. Rows are taken as they are in
+// the files, so pending journal edits are not included.
+void querySales(const std::vector<std::string>& filenames, bool partitions, const SalesQuery& query,
+                const std::string& reportFilename, unsigned threadCount) {
+    STATS_PHASE(PhaseQuery);
+    std::vector<MappedFile> inputs;
+    std::size_t bytes = 0;
+    for (const auto& filename : filenames) {
+        inputs.emplace_back(filename);
+        if (!inputs.back().is_open()) {
+            std::cerr << "Error: Could not open file " << filename << ".\n";
+            return;
+        }
+        bytes += inputs.back().data().size();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    SalesCopy matches;
+    StringDictionary dictionary;
+    std::size_t scanned = 0;
+    for (std::size_t i = 0; i < inputs.size(); ++i) {
+        std::size_t skipped = 0;
+        std::size_t duplicates = 0;
+        scanned += filterSaleRows(inputs[i].data(), query, partitions, matches.rows, dictionary, skipped, duplicates);
+        if (skipped > 0) {
+            std::cerr << "Warning: Skipped " << skipped << " malformed row(s) in " << filenames[i] << ".\n";
+        }
+        if (duplicates > 0) {
+            std::cerr << "Warning: Dropped " << duplicates << " matching row(s) with a duplicate sale ID in " << filenames[i] << ".\n";
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::sort(matches.rows.begin(), matches.rows.end(), [](const Sale& a, const Sale& b) {
+        return a.dateKey != b.dateKey ? a.dateKey < b.dateKey : a.saleID < b.saleID;
+    });
+    matches.strings = dictionary.strings;
+    matches.order.resize(matches.rows.size());
+    for (std::size_t i = 0; i < matches.order.size(); ++i) {
+        matches.order[i] = static_cast<std::uint32_t>(i);
+    }
+    generateReport(reportFilename, matches, threadCount);
+
+    double megabytes = bytes / (1024.0 * 1024.0);
+    std::cout << "Matched " << matches.size() << " of " << scanned << " sale(s); scanned "
+              << std::fixed << std::setprecision(1) << megabytes << " MB from " << inputs.size() << " file(s) in "
+              << std::setprecision(4) << seconds << " sec ("
+              << std::setprecision(0) << (seconds > 0 ? megabytes / seconds : 0.0) << " MB/sec).\n";
+    STATS_ROWS(scanned);
+    STATS_BYTES(bytes);
+}
+
+// Function to check for edits in a journal that are not in input.csv yet
+bool journalPending(const std::string& filename) {
+    std::ifstream pending(filename);
+    return pending.is_open() && pending.peek() != std::ifstream::traits_type::eof();
+}
+
+// Function to load sales by mapping the CSV file and parsing fields in place.
+// Only the first copy of each distinct description or item is copied out,
+// so the mapping can be dropped once loading is done.
+// With more than one thread the file is cut into newline-aligned chunks that
+// are parsed concurrently and joined back in file order, so the result is the
+// same for every thread count.
+SalesStore loadSalesMapped(const std::string& filename, unsigned threadCount) {
+    STATS_PHASE(PhaseLoadMapped);
+    SalesStore store;
+    MappedFile file(filename);
+
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not open file " << filename << ".\n";
+        return store;
+    }
+
+    std::string_view data = file.data();
+    STATS_BYTES(data.size());
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    // Small inputs are not worth a thread each
+    const std::size_t minChunkBytes = 1 << 20;
+    threadCount = static_cast<unsigned>(std::min<std::size_t>(threadCount, data.size() / minChunkBytes + 1));
+
+    std::vector<std::string_view> chunks;
+    std::size_t begin = 0;
+    for (unsigned i = 1; i <= threadCount && begin < data.size(); ++i) {
+        std::size_t end = data.size() * i / threadCount;
+        if (end < begin) {
+            end = begin;
+        }
+        if (i < threadCount) {
+            std::size_t newline = data.find('\n', end);
+            end = newline == std::string_view::npos ? data.size() : newline + 1;
+        }
+        chunks.push_back(data.substr(begin, end - begin));
+        begin = end;
+    }
+
+    std::size_t skipped = 0;
+    if (chunks.size() <= 1) {
+        skipped = parseSaleRows(data, store.rows, store.dictionary);
+    } else {
+        // Each worker interns into its own dictionary of views into the
+        // mapping; the codes are translated to the store's dictionary after.
+        std::vector<std::vector<Sale>> parts(chunks.size());
+        std::vector<StringDictionary> partDictionaries(chunks.size());
+        std::vector<std::size_t> partSkipped(chunks.size(), 0);
+        std::vector<std::thread> workers;
+        for (std::size_t i = 0; i < chunks.size(); ++i) {
+            workers.emplace_back([&, i] {
+                partSkipped[i] = parseSaleRows(chunks[i], parts[i], partDictionaries[i], false);
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+
+        joinSaleParts(store, parts, partDictionaries);
+        for (std::size_t count : partSkipped) {
+            skipped += count;
+        }
+    }
+
+    if (skipped > 0) {
+        std::cerr << "Warning: Skipped " << skipped << " malformed row(s) in " << filename << ".\n";
+    }
+    STATS_ROWS(store.rows.size());
+    return store;
+}
+
+// Function to write sales to a CSV file, adding the bytes written to bytes.
+// The rows are written to a side file that then replaces the target, so
+// readers never see a half-written file. Returns false if the target was
+// not replaced.
+template <typename Sales>
+bool writeSalesFile(const std::string& filename, const Sales& sales, std::size_t& bytes) {
+    AtomicFile file(filename);
+
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not open file " << filename << " for writing.\n";
+        return false;
+    }
+
+    std::string& buffer = file.buffer();
+    for (std::size_t i = 0; i < sales.size(); ++i) {
+        const Sale& sale = sales[i];
+        std::size_t before = buffer.size();
+        appendSaleLine(buffer, sale, sales.text(sale.descriptionCode), sales.text(sale.itemCode));
+        buffer.push_back('\n');
+        bytes += buffer.size() - before;
+        file.flushIfFull();
+    }
+    return file.commit();
+}
+
+// Function to save sales to a CSV file
+template <typename Sales>
+bool saveSales(const std::string& filename, const Sales& sales) {
+    STATS_PHASE(PhaseSave);
+    std::size_t bytes = 0;
+    bool saved = writeSalesFile(filename, sales, bytes);
+    STATS_ROWS(sales.size());
+    STATS_BYTES(bytes);
+    return saved;
+}
+
+// Function to save sales that are already in date order, e.g. a checkpoint
+// copy to temp.csv. Timed with sortAndSaveSales rather than saveSales.
+template <typename Sales>
+bool saveSortedSales(const std::string& filename, const Sales& sales) {
+    STATS_PHASE(PhaseSortAndSave);
+    std::size_t bytes = 0;
+    bool saved = writeSalesFile(filename, sales, bytes);
+    STATS_ROWS(sales.size());
+    STATS_BYTES(bytes);
+    return saved;
+}
+
+// Function to display sales
+template <typename Sales>
+void displaySales(const Sales& sales) {
+    for (std::size_t i = 0; i < sales.size(); ++i) {
+        const Sale& sale = sales[i];
+        std::cout << "Date: " << formatDate(sale.dateKey) 
+                  << ", Sale ID: " << sale.saleID 
+                  << ", Description: " << sales.text(sale.descriptionCode) 
+                  << ", Item: " << sales.text(sale.itemCode) 
+                  << ", Quantity: " << sale.quantity 
+                  << ", Unit Price: " << formatPrice(sale.unitPrice) 
+                  << ", Sales Amount: " << formatPrice(sale.salesAmount()) 
+                  << "\n";
+    }
+}
+
+// Function to rebuild the sale ID and date indexes after the rows were
+// loaded. Rows repeating an ID that is already indexed are dropped.
+void indexSales(SalesStore& store) {
+    store.index.clear();
+    store.index.reserve(store.rows.size());
+
+    std::size_t kept = 0;
+    std::vector<int> duplicates;
+    for (std::size_t i = 0; i < store.rows.size(); ++i) {
+        const Sale& sale = store.rows[i];
+        if (!store.index.emplace(sale.saleID, kept).second) {
+            duplicates.push_back(sale.saleID);
+            continue;
+        }
+        store.rows[kept++] = sale;
+    }
+    store.rows.resize(kept);
+
+    std::vector<std::pair<int, int>> keys;
+    keys.reserve(store.rows.size());
+    for (const auto& sale : store.rows) {
+        keys.emplace_back(sale.dateKey, sale.saleID);
+    }
+    std::sort(keys.begin(), keys.end());
+    store.byDate.clear();
+    for (const auto& key : keys) {
+        store.byDate.emplace_hint(store.byDate.end(), key);
+    }
+    store.aggregates = aggregateSales(store.rows);
+    store.dirtyMonths.clear();
+
+    if (!duplicates.empty()) {
+        std::cerr << "Warning: Dropped " << duplicates.size() << " row(s) with a duplicate sale ID:";
+        for (std::size_t i = 0; i < duplicates.size() && i < 10; ++i) {
+            std::cerr << " " << duplicates[i];
+        }
+        std::cerr << (duplicates.size() > 10 ? " ...\n" : "\n");
+    }
+}
+
+// Function to look up a sale by ID; returns nullptr if there is none
+Sale* findSale(SalesStore& store, int saleID) {
+    auto it = store.index.find(saleID);
+    return it == store.index.end() ? nullptr : &store.rows[it->second];
+}
+
+// Function to add a sale unless its ID is already taken
+bool insertSale(SalesStore& store, const Sale& sale) {
+    if (!store.index.emplace(sale.saleID, store.rows.size()).second) {
+        return false;
+    }
+    store.rows.push_back(sale);
+    store.byDate.emplace(sale.dateKey, sale.saleID);
+    store.aggregates.add(sale);
+    store.dirtyMonths.insert(sale.dateKey / 100);
+    return true;
+}
+
+// Function to remove a sale by ID. The last row takes the freed slot, so
+// the cost does not depend on the number of sales.
+bool eraseSale(SalesStore& store, int saleID) {
+    auto it = store.index.find(saleID);
+    if (it == store.index.end()) {
+        return false;
+    }
+    std::size_t position = it->second;
+    store.index.erase(it);
+    store.byDate.erase({store.rows[position].dateKey, saleID});
+    store.aggregates.remove(store.rows[position]);
+    store.dirtyMonths.insert(store.rows[position].dateKey / 100);
+
+    if (position + 1 != store.rows.size()) {
+        store.rows[position] = store.rows.back();
+        store.index[store.rows[position].saleID] = position;
+    }
+    store.rows.pop_back();
+    return true;
+}
+
+// Function to overwrite a stored sale, moving it to its new place in date
+// order. The sale ID must stay the same.
+void assignSale(SalesStore& store, Sale& target, const Sale& sale) {
+    if (target.dateKey != sale.dateKey) {
+        store.byDate.erase({target.dateKey, target.saleID});
+        store.byDate.emplace(sale.dateKey, sale.saleID);
+    }
+    store.aggregates.remove(target);
+    store.aggregates.add(sale);
+    store.dirtyMonths.insert(target.dateKey / 100);
+    store.dirtyMonths.insert(sale.dateKey / 100);
+    target = sale;
+}
+
+// Function to take a sale out of the totals of its date, its item and the
+// store
+void SalesAggregates::remove(const Sale& sale) {
+    auto date = dates.find(sale.dateKey);
+    date->second.add(sale, -1);
+    if (date->second.count == 0) {
+        dates.erase(date);
+    }
+    auto item = items.find(sale.itemCode);
+    item->second.add(sale, -1);
+    if (item->second.count == 0) {
+        items.erase(item);
+    }
+    total.add(sale, -1);
+}
+
+// Function to total rows from scratch, per date, per item and overall
+SalesAggregates aggregateSales(const std::vector<Sale>& rows) {
+    SalesAggregates aggregates;
+    for (const auto& sale : rows) {
+        aggregates.add(sale);
+    }
+    return aggregates;
+}
+
+// Function to compare the totals kept by a store's edits with a full
+// recompute from its rows. Prints each difference found.
+bool verifyAggregates(const SalesStore& store) {
+    SalesAggregates expected = aggregateSales(store.rows);
+    const SalesAggregates& kept = store.aggregates;
+    std::size_t mismatches = 0;
+    auto report = [&](const std::string& group, const RunningTotals* have, const RunningTotals* want) {
+        if ((have == nullptr && want == nullptr) || (have && want && *have == *want)) {
+            return;
+        }
+        if (++mismatches <= 10) {
+            std::cerr << "Error: Totals for " << group << " are ";
+            if (have) {
+                std::cerr << have->count << " sale(s), quantity " << have->quantity << ", amount " << formatPrice(have->amount);
+            } else {
+                std::cerr << "missing";
+            }
+            std::cerr << " but should be ";
+            if (want) {
+                std::cerr << want->count << " sale(s), quantity " << want->quantity << ", amount " << formatPrice(want->amount);
+            } else {
+                std::cerr << "absent";
+            }
+            std::cerr << ".\n";
+        }
+    };
+    auto find = [](const auto& groups, const auto& key) -> const RunningTotals* {
+        auto it = groups.find(key);
+        return it == groups.end() ? nullptr : &it->second;
+    };
+
+    for (const auto& [date, totals] : expected.dates) {
+        report("date " + formatDate(date), find(kept.dates, date), &totals);
+    }
+    for (const auto& [date, totals] : kept.dates) {
+        if (!expected.dates.count(date)) {
+            report("date " + formatDate(date), &totals, nullptr);
+        }
+    }
+    for (const auto& [code, totals] : expected.items) {
+        report("item " + std::string(store.text(code)), find(kept.items, code), &totals);
+    }
+    for (const auto& [code, totals] : kept.items) {
+        if (!expected.items.count(code)) {
+            report("item " + std::string(store.text(code)), &totals, nullptr);
+        }
+    }
+    report("all sales", &kept.total, &expected.total);
+
+    if (mismatches > 0) {
+        std::cerr << "Error: " << mismatches << " aggregate(s) differ from a full recompute.\n";
+        return false;
+    }
+    std::cout << "Aggregates match a full recompute: " << expected.dates.size() << " date(s), "
+              << expected.items.size() << " item(s), " << expected.total.count << " sale(s).\n";
+    return true;
+}
+
+// Function to check the running totals under a stream of random edits. The
+// edits only change the store in memory; nothing is journaled or saved.
+bool exerciseAggregates(SalesStore& store, std::size_t editCount, std::uint64_t seed) {
+    if (store.rows.empty()) {
+        return verifyAggregates(store);
+    }
+    std::mt19937_64 random(seed);
+    int nextID = 0;
+    for (const auto& sale : store.rows) {
+        nextID = std::max(nextID, sale.saleID + 1);
+    }
+    for (std::size_t n = 0; n < editCount && !store.rows.empty(); ++n) {
+        // New values are borrowed from random rows, so they are valid dates
+        // and codes that are already in the dictionary
+        const Sale& donor = store.rows[random() % store.rows.size()];
+        Sale sale = store.rows[random() % store.rows.size()];
+        sale.dateKey = donor.dateKey;
+        sale.itemCode = donor.itemCode;
+        sale.quantity = static_cast<int>(random() % 500) + 1;
+        sale.unitPrice = static_cast<std::int64_t>(random() % 100000) + 1;
+        switch (random() % 3) {
+            case 0:
+                sale.saleID = nextID++;
+                insertSale(store, sale);
+                break;
+            case 1:
+                assignSale(store, *findSale(store, sale.saleID), sale);
+                break;
+            default:
+                eraseSale(store, sale.saleID);
+        }
+    }
+    std::cout << "Applied " << editCount << " random edit(s) in memory.\n";
+    return verifyAggregates(store);
+}
+
+// Function to list the sales in date order, ties broken by sale ID.
+// The order is kept up to date on every edit, so no sorting happens here.
+SortedSales salesByDate(const SalesStore& store) {
+    SortedSales sorted{&store, {}};
+    sorted.order.reserve(store.rows.size());
+    for (const auto& key : store.byDate) {
+        sorted.order.push_back(store.index.at(key.second));
+    }
+    return sorted;
+}
+
+// Function to add a new sale
+void createSale(SalesStore& store, SalesJournal& journal) {
+    Sale newSale;
+    std::string value;
+    newSale.dateKey = validateDateInput("Enter sale date (YYYY-MM-DD): ");
+    newSale.saleID = validateIntegerInput("Enter sale ID: ");
+    if (findSale(store, newSale.saleID) != nullptr) {
+        std::cerr << "Error: Sale ID " << newSale.saleID << " already exists.\n";
+        return;
+    }
+    std::string item;
+    std::cout << "Enter description: ";
+    std::cin.ignore();
+    std::getline(std::cin, value);
+    std::cout << "Enter item name: ";
+    std::getline(std::cin, item);
+    newSale.quantity = validateIntegerInput("Enter quantity: ");
+    newSale.unitPrice = validatePriceInput("Enter unit price: ");
+
+    // Timed from here, so the time spent at the prompts is left out
+    STATS_PHASE(PhaseCreate);
+    std::lock_guard<std::shared_mutex> lock(journal.mutex);
+    newSale.descriptionCode = store.dictionary.intern(value);
+    newSale.itemCode = store.dictionary.intern(item);
+    insertSale(store, newSale);
+    appendJournal(journal, 'C', newSale, store);
+    STATS_ROWS(1);
+
+    std::cout << "Sale added successfully!\n";
+}
+
+// Function to update an existing sale
+void updateSale(SalesStore& store, SalesJournal& journal) {
+    int saleID = validateIntegerInput("Enter the sale ID to update: ");
+
+    Sale* found = findSale(store, saleID);
+    if (found == nullptr) {
+        std::cerr << "Error: Sale ID not found.\n";
+        return;
+    }
+
+    Sale sale = *found;
+    std::string value;
+    std::string item;
+    sale.dateKey = validateDateInput("Enter new sale date (YYYY-MM-DD): ");
+    std::cout << "Enter new description: ";
+    std::cin.ignore();
+    std::getline(std::cin, value);
+    std::cout << "Enter new item name: ";
+    std::getline(std::cin, item);
+    sale.quantity = validateIntegerInput("Enter new quantity: ");
+    sale.unitPrice = validatePriceInput("Enter new unit price: ");
+
+    STATS_PHASE(PhaseUpdate);
+    std::lock_guard<std::shared_mutex> lock(journal.mutex);
+    sale.descriptionCode = store.dictionary.intern(value);
+    sale.itemCode = store.dictionary.intern(item);
+    assignSale(store, *found, sale);
+    appendJournal(journal, 'U', sale, store);
+    STATS_ROWS(1);
+
+    std::cout << "Sale updated successfully!\n";
+}
+
+// Function to delete an existing sale
+void deleteSale(SalesStore& store, SalesJournal& journal) {
+    int saleID = validateIntegerInput("Enter the sale ID to delete: ");
+
+    STATS_PHASE(PhaseDelete);
+    std::unique_lock<std::shared_mutex> lock(journal.mutex);
+    if (eraseSale(store, saleID)) {
+        Sale deleted{};
+        deleted.saleID = saleID;
+        appendJournal(journal, 'D', deleted, store);
+        lock.unlock();
+        STATS_ROWS(1);
+
+        std::cout << "Sale deleted successfully!\n";
+    } else {
+        std::cerr << "Error: Sale ID not found.\n";
+    }
+}
+
+// Function to save sales in date order to temp.csv
+void sortAndSaveSales(const SalesStore& store) {
+    STATS_PHASE(PhaseSortAndSave);
+    std::size_t bytes = 0;
+    writeSalesFile("temp.csv", salesByDate(store), bytes);
+    STATS_ROWS(store.rows.size());
+    STATS_BYTES(bytes);
+    std::cout << "Sales sorted by date and saved to temp.csv.\n";
+}
+
+// Function to format a sale as one CSV line. Numbers use the shortest text
+// that reads back to the same value.
+std::string formatSaleLine(const Sale& sale, const SalesStore& store) {
+    std::string_view description = store.text(sale.descriptionCode);
+    std::string_view item = store.text(sale.itemCode);
+    std::string line;
+    line.reserve(description.size() + item.size() + 64);
+    appendSaleLine(line, sale, description, item);
+    return line;
+}
+
+// Function to append a sale as one CSV line, without the newline, in the
+// same form saveSales writes
+void appendSaleLine(std::string& line, const Sale& sale, std::string_view description, std::string_view item) {
+    char numbers[64];
+    formatDate(sale.dateKey, numbers);
+    line.append(numbers, 10).push_back(',');
+    line.append(numbers, std::to_chars(numbers, numbers + sizeof(numbers), sale.saleID).ptr);
+    line.push_back(',');
+    line.append(description).push_back(',');
+    line.append(item).push_back(',');
+    line.append(numbers, std::to_chars(numbers, numbers + sizeof(numbers), sale.quantity).ptr);
+    line.push_back(',');
+    line.append(numbers, formatPrice(sale.unitPrice, numbers));
+}
+
+// Function to sort a sales CSV file by date into another file without
+// holding all of it in memory. Rows are read into runs of at most
+// memoryBudget bytes; each run is sorted and spilled to a temporary file,
+// and the runs are then merged. The output matches loading the file and
+// calling sortAndSaveSales: malformed rows are skipped, later rows repeating
+// a sale ID are dropped, and rows are ordered by (date, sale ID).
+bool sortSalesExternal(const std::string& inputFilename, const std::string& outputFilename, std::size_t memoryBudget) {
+    MappedFile input(inputFilename);
+    if (!input.is_open()) {
+        std::cerr << "Error: Could not open file " << inputFilename << ".\n";
+        return false;
+    }
+
+    SeenSaleIDs seen;
+
+    struct RunRow {
+        int dateKey;
+        int saleID;
+        std::size_t offset; // Line start in the run text
+        std::size_t length;
+    };
+    std::vector<RunRow> run;
+    std::string runText;
+    std::vector<std::string> runFiles;
+    bool failed = false;
+
+    auto spill = [&]() {
+        std::sort(run.begin(), run.end(), [](const RunRow& a, const RunRow& b) {
+            return a.dateKey != b.dateKey ? a.dateKey < b.dateKey : a.saleID < b.saleID;
+        });
+        std::string name = outputFilename + ".run" + std::to_string(runFiles.size());
+        std::ofstream out(name, std::ios::binary);
+        std::string buffer;
+        for (const RunRow& row : run) {
+            buffer.append(runText, row.offset, row.length);
+            if (buffer.size() >= (1 << 20)) {
+                out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+                buffer.clear();
+            }
+        }
+        out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        out.close();
+        if (!out) {
+            std::cerr << "Error: Could not write sort run " << name << ".\n";
+            failed = true;
+        }
+        runFiles.push_back(name);
+        run.clear();
+        runText.clear();
+    };
+
+    std::string_view data = input.data();
+    std::size_t skipped = 0;
+    std::size_t rows = 0;
+    while (!data.empty() && !failed) {
+        std::size_t newline = data.find('\n');
+        std::string_view line = data.substr(0, newline);
+        data.remove_prefix(newline == std::string_view::npos ? data.size() : newline + 1);
+        if (line.empty() || line == "\r") {
+            continue;
+        }
+
+        Sale sale;
+        std::string_view description;
+        std::string_view item;
+        if (!parseSaleFields(line, sale, description, item)) {
+            ++skipped;
+            continue;
+        }
+        if (!seen.insert(sale.saleID)) {
+            continue;
+        }
+        std::size_t offset = runText.size();
+        appendSaleLine(runText, sale, description, item);
+        runText.push_back('\n');
+        run.push_back(RunRow{sale.dateKey, sale.saleID, offset, runText.size() - offset});
+        ++rows;
+
+        if (runText.size() + run.size() * sizeof(RunRow) >= memoryBudget) {
+            spill();
+        }
+    }
+    if (!run.empty() && !failed) {
+        spill();
+    }
+    if (skipped > 0) {
+        std::cerr << "Warning: Skipped " << skipped << " malformed row(s) in " << inputFilename << ".\n";
+    }
+
+    // Merge: each run file contributes its current line, keyed by the date
+    // and sale ID at the start of the line
+    struct RunReader {
+        std::ifstream file;
+        std::string line;
+        int dateKey = 0;
+        int saleID = 0;
+
+        bool next() {
+            if (!std::getline(file, line)) {
+                return false;
+            }
+            parseDate(std::string_view(line).substr(0, 10), dateKey);
+            std::from_chars(line.data() + 11, line.data() + line.size(), saleID);
+            return true;
+        }
+    };
+    std::vector<RunReader> readers(runFiles.size());
+    using Head = std::pair<std::pair<int, int>, std::size_t>; // ((date, ID), reader)
+    std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+    for (std::size_t i = 0; i < runFiles.size() && !failed; ++i) {
+        readers[i].file.open(runFiles[i], std::ios::binary);
+        if (readers[i].next()) {
+            heads.push({{readers[i].dateKey, readers[i].saleID}, i});
+        }
+    }
+
+    AtomicFile output(outputFilename);
+    if (!output.is_open()) {
+        std::cerr << "Error: Could not open file " << outputFilename << " for writing.\n";
+        failed = true;
+    }
+    while (!heads.empty() && !failed) {
+        std::size_t i = heads.top().second;
+        heads.pop();
+        output.buffer().append(readers[i].line).push_back('\n');
+        output.flushIfFull();
+        if (readers[i].next()) {
+            heads.push({{readers[i].dateKey, readers[i].saleID}, i});
+        }
+    }
+
+    readers.clear();
+    for (const auto& name : runFiles) {
+        std::remove(name.c_str());
+    }
+    if (failed || !output.commit()) {
+        return false;
+    }
+    std::cout << "Sorted " << rows << " sale(s) in " << runFiles.size() << " run(s) and saved to "
+              << outputFilename << ".\n";
+    return true;
+}
+
+// Function to open the journal for appending new records
+bool openJournal(SalesJournal& journal, const std::string& filename) {
+    journal.filename = filename;
+    journal.out.open(filename, std::ios::app);
+    if (!journal.out.is_open()) {
+        std::cerr << "Error: Could not open journal " << filename << " for writing.\n";
+        return false;
+    }
+    return true;
+}
+
+// Function to append one edit to the journal. Records are one line each:
+// "C,<sale>" for a new sale, "U,<sale>" for an update and "D,<saleID>" for
+// a delete.
+void appendJournal(SalesJournal& journal, char kind, const Sale& sale, const SalesStore& store) {
+    std::string record(1, kind);
+    record.push_back(',');
+    if (kind == 'D') {
+        record += std::to_string(sale.saleID);
+    } else {
+        record += formatSaleLine(sale, store);
+    }
+    record.push_back('\n');
+
+    journal.out << record;
+    journal.out.flush();
+    if (!journal.out) {
+        std::cerr << "Error: Could not write to journal " << journal.filename << ".\n";
+        return;
+    }
+    if (journal.records == 0) {
+        journal.dirtySince = std::chrono::steady_clock::now();
+    } else if (journal.records == journal.copied) {
+        journal.tailSince = std::chrono::steady_clock::now();
+    }
+    ++journal.records;
+}
+
+// Function to apply the journal left by a previous run on top of the loaded
+// sales. Creates and updates replace the sale with the same ID, so replaying
+// a journal that was already folded into input.csv changes nothing.
+std::size_t replayJournal(SalesStore& store, const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        return 0;
+    }
+    std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    std::string_view data = contents;
+
+    std::size_t applied = 0;
+    std::size_t skipped = 0;
+    while (!data.empty()) {
+        std::size_t newline = data.find('\n');
+        std::string_view line = data.substr(0, newline);
+        data.remove_prefix(newline == std::string_view::npos ? data.size() : newline + 1);
+
+        if (line.size() < 3 || line[1] != ',') {
+            // A torn final record from a crash mid-append is expected here
+            if (!line.empty()) {
+                ++skipped;
+            }
+            continue;
+        }
+        char kind = line[0];
+        line.remove_prefix(2);
+
+        if (kind == 'D') {
+            int saleID;
+            auto result = std::from_chars(line.data(), line.data() + line.size(), saleID);
+            if (result.ec != std::errc()) {
+                ++skipped;
+                continue;
+            }
+            eraseSale(store, saleID);
+        } else if (kind == 'C' || kind == 'U') {
+            Sale sale;
+            if (!parseSaleLine(line, sale, store.dictionary)) {
+                ++skipped;
+                continue;
+            }
+            if (Sale* existing = findSale(store, sale.saleID)) {
+                assignSale(store, *existing, sale);
+            } else {
+                insertSale(store, sale);
+            }
+        } else {
+            ++skipped;
+            continue;
+        }
+        ++applied;
+    }
+
+    if (skipped > 0) {
+        std::cerr << "Warning: Skipped " << skipped << " unreadable journal record(s) in " << filename << ".\n";
+    }
+    return applied;
+}
+
+// Function to apply a batch of operations in the journal format to the store.
+// Unlike journal replay, every operation must make sense against the current
+// sales: C needs a new ID, U and D an existing one. Others are rejected.
+// Returns the number of operations applied.
+std::size_t applyBatch(SalesStore& store, std::string_view data, std::size_t& rejected) {
+    const std::size_t reportLimit = 10;
+    std::size_t applied = 0;
+    std::size_t lineNumber = 0;
+    rejected = 0;
+
+    auto reject = [&](const char* reason) {
+        if (rejected < reportLimit) {
+            std::cerr << "Error: Line " << lineNumber << ": " << reason << ".\n";
+        }
+        ++rejected;
+    };
+
+    while (!data.empty()) {
+        std::size_t newline = data.find('\n');
+        std::string_view line = data.substr(0, newline);
+        data.remove_prefix(newline == std::string_view::npos ? data.size() : newline + 1);
+        ++lineNumber;
+
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        if (line.empty()) {
+            continue;
+        }
+        Sale sale;
+        if (const char* reason = applyOperation(store, line, sale)) {
+            reject(reason);
+        } else {
+            ++applied;
+        }
+    }
+
+    if (rejected > reportLimit) {
+        std::cerr << "Error: " << rejected - reportLimit << " more rejected line(s) not shown.\n";
+    }
+    return applied;
+}
+
+// Function to apply one operation in the journal format. Returns nullptr on
+// success, with the created or updated sale (or just the ID of a deleted
+// one) in applied, and otherwise the reason it was rejected.
+const char* applyOperation(SalesStore& store, std::string_view line, Sale& applied) {
+    if (line.size() < 3 || line[1] != ',') {
+        return "expected C, U or D followed by a comma";
+    }
+    char kind = line[0];
+    line.remove_prefix(2);
+
+    if (kind == 'D') {
+        applied = Sale{};
+        const char* end = line.data() + line.size();
+        auto result = std::from_chars(line.data(), end, applied.saleID);
+        if (result.ec != std::errc() || result.ptr != end) {
+            return "invalid sale ID";
+        }
+        return eraseSale(store, applied.saleID) ? nullptr : "sale ID not found";
+    }
+    if (kind != 'C' && kind != 'U') {
+        return "unknown operation";
+    }
+    if (!parseSaleLine(line, applied, store.dictionary)) {
+        return "malformed sale";
+    }
+    Sale* existing = findSale(store, applied.saleID);
+    if (kind == 'C' && existing) {
+        return "sale ID already exists";
+    }
+    if (kind == 'U' && !existing) {
+        return "sale ID not found";
+    }
+    if (existing) {
+        assignSale(store, *existing, applied);
+    } else {
+        insertSale(store, applied);
+    }
+    return nullptr;
+}
+
+// Function to apply a batch file and persist the result once: one write of
+// input.csv, one sort and write of temp.csv, and the snapshot
+void runBatch(SalesStore& store, SalesJournal& journal, const std::string& filename) {
+    MappedFile file(filename);
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not open file " << filename << ".\n";
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::size_t rejected = 0;
+    std::size_t applied = applyBatch(store, file.data(), rejected);
+    auto applyStop = std::chrono::steady_clock::now();
+
+    // Any replayed journal records are folded in by the same checkpoint
+    journal.records += applied;
+    checkpointSales(store, journal);
+    auto stop = std::chrono::steady_clock::now();
+
+    double applySeconds = std::chrono::duration<double>(applyStop - start).count();
+    double totalSeconds = std::chrono::duration<double>(stop - start).count();
+    std::size_t operations = applied + rejected;
+    std::cout << "Applied  : " << applied << "\n"
+              << "Rejected : " << rejected << "\n"
+              << std::fixed << std::setprecision(4)
+              << "Apply (sec)   : " << applySeconds << "\n"
+              << "Persist (sec) : " << totalSeconds - applySeconds << "\n"
+              << std::setprecision(0)
+              << "Operations/sec: " << (totalSeconds > 0 ? operations / totalSeconds : 0.0) << "\n";
+}
+
+// Function to fold the journal into input.csv, temp.csv and the snapshot and
+// drop the folded records from the journal. Returns false if there was
+// nothing to fold or a file could not be written; a failed checkpoint keeps
+// the journal and the dirty months for the next try. The store is copied
+// under a shared journal lock and written without it, so edits are only held
+// up for the copy. Edits made while the files are written stay in the
+// journal for the next checkpoint.
+bool checkpointSales(SalesStore& store, SalesJournal& journal) {
+    std::lock_guard<std::mutex> checkpointLock(journal.checkpointMutex);
+    SalesCopy copy;
+    std::vector<std::pair<int, SalesCopy>> months;
+    std::set<int> dirtyMonths;
+    std::size_t records;
+    std::streamoff journalEnd;
+    {
+        // Besides edits, which hold the lock exclusively, only checkpoints
+        // touch dirtyMonths, and they run one at a time
+        std::shared_lock<std::shared_mutex> lock(journal.mutex);
+        if (journal.records == 0) {
+            return false;
+        }
+        if (journal.partitions != nullptr) {
+            for (int month : store.dirtyMonths) {
+                months.emplace_back(month, copySalesRange(store, month * 100 + 1, month * 100 + 31));
+            }
+        } else {
+            copy = copySales(store);
+        }
+        dirtyMonths.swap(store.dirtyMonths);
+        records = journal.records;
+        journal.copied = records;
+        journalEnd = journal.out.tellp();
+    }
+
+    bool saved = true;
+    if (journal.partitions != nullptr) {
+        // Only the months that were edited are rewritten
+        for (const auto& [month, sales] : months) {
+            saved &= writePartition(*journal.partitions, month, sales);
+        }
+        saved = saved && writeManifest(*journal.partitions);
+    } else {
+        saved = saveSales("input.csv", copy) && saveSortedSales("temp.csv", SalesCopyByDate{&copy})
+            && saveSnapshot("input.snapshot", copy, "input.csv");
+    }
+
+    std::lock_guard<std::shared_mutex> lock(journal.mutex);
+    journal.copied = 0;
+    if (!saved) {
+        std::cerr << "Error: Checkpoint failed; edits stay in journal " << journal.filename << ".\n";
+        store.dirtyMonths.insert(dirtyMonths.begin(), dirtyMonths.end());
+        return false;
+    }
+    std::string tail;
+    if (journal.records > records) {
+        // Keep the records appended after the copy was taken
+        std::ifstream pending(journal.filename, std::ios::binary);
+        pending.seekg(journalEnd);
+        tail.assign(std::istreambuf_iterator<char>(pending), std::istreambuf_iterator<char>());
+    }
+    // The shortened journal replaces the old one only once it is on disk,
+    // so a crash leaves the tail in one journal or the other
+    journal.out.close();
+    AtomicFile shortened(journal.filename);
+    bool replaced = false;
+    if (shortened.is_open()) {
+        shortened.write(tail);
+        replaced = shortened.commit();
+    }
+    journal.out.open(journal.filename, std::ios::app);
+    if (!replaced || !journal.out.is_open()) {
+        std::cerr << "Error: Could not reset journal " << journal.filename << ".\n";
+        return false;
+    }
+    journal.records -= records;
+    if (journal.records > 0) {
+        journal.dirtySince = journal.tailSince;
+    }
+    ++journal.checkpoints;
+    return true;
+}
+
+// Function to name the file of one month's partition, e.g. 2024-03.csv
+std::string partitionFilename(const PartitionManifest& manifest, int month) {
+    char text[10];
+    formatDate(month * 100 + 1, text);
+    return manifest.directory + "/" + std::string(text, 7) + ".csv";
+}
+
+// Function to name the journal of a partitioned store
+std::string partitionJournalFilename(const std::string& directory) {
+    return directory + "/sales.journal";
+}
+
+// Function to read the manifest of a partitioned store. Returns false if
+// the directory has no readable manifest.
+bool readManifest(PartitionManifest& manifest, const std::string& directory) {
+    manifest.directory = directory;
+    manifest.partitions.clear();
+    std::ifstream file(directory + "/manifest.csv");
+    if (!file.is_open()) {
+        return false;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        std::string_view fields[4];
+        std::string_view rest = line;
+        for (int i = 0; i < 3; ++i) {
+            std::size_t comma = rest.find(',');
+            fields[i] = rest.substr(0, comma);
+            rest.remove_prefix(comma == std::string_view::npos ? rest.size() : comma + 1);
+        }
+        fields[3] = rest;
+
+        PartitionInfo info;
+        int firstOfMonth;
+        const char* end = fields[3].data() + fields[3].size();
+        auto result = std::from_chars(fields[3].data(), end, info.rows);
+        if (!parseDate(std::string(fields[0]) + "-01", firstOfMonth) || !parseDate(fields[1], info.minDate)
+            || !parseDate(fields[2], info.maxDate) || result.ec != std::errc() || result.ptr != end) {
+            std::cerr << "Error: Malformed line in " << directory << "/manifest.csv: " << line << "\n";
+            return false;
+        }
+        info.month = firstOfMonth / 100;
+        manifest.partitions[info.month] = info;
+    }
+    return true;
+}
+
+// Function to write the manifest of a partitioned store
+bool writeManifest(const PartitionManifest& manifest) {
+    AtomicFile file(manifest.directory + "/manifest.csv");
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not open the manifest in " << manifest.directory << " for writing.\n";
+        return false;
+    }
+    for (const auto& [month, info] : manifest.partitions) {
+        char text[10];
+        formatDate(month * 100 + 1, text);
+        file.write(std::string_view(text, 7));
+        file.write("," + formatDate(info.minDate) + "," + formatDate(info.maxDate) + "," + std::to_string(info.rows) + "\n");
+    }
+    return file.commit();
+}
+
+// Function to write one month's sales, which must be in date order, to its
+// partition and update its manifest entry. A month with no sales left loses
+// its file and its entry. The manifest itself is written by the caller.
+// Returns false, leaving the entry alone, if the file could not be written.
+bool writePartition(PartitionManifest& manifest, int month, const SalesCopy& sales) {
+    std::string filename = partitionFilename(manifest, month);
+    if (sales.size() == 0) {
+        std::remove(filename.c_str());
+        manifest.partitions.erase(month);
+        return true;
+    }
+    if (!saveSales(filename, sales)) {
+        return false;
+    }
+    PartitionInfo& info = manifest.partitions[month];
+    info.month = month;
+    info.minDate = sales[0].dateKey;
+    info.maxDate = sales[sales.size() - 1].dateKey;
+    info.rows = sales.size();
+    return true;
+}
+
+// Function to split a store into one partition file per month plus the
+// manifest, replacing any partitions already in the directory. A journal
+// left in the directory belongs to the replaced partitions, so it is removed
+// once the new manifest is written.
+bool partitionSales(const SalesStore& store, const std::string& directory) {
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    PartitionManifest manifest;
+    readManifest(manifest, directory);
+
+    std::set<int> months;
+    for (const auto& key : store.byDate) {
+        months.insert(key.first / 100);
+    }
+    std::vector<int> stale;
+    for (const auto& entry : manifest.partitions) {
+        if (!months.count(entry.first)) {
+            stale.push_back(entry.first);
+        }
+    }
+    for (int month : months) {
+        if (!writePartition(manifest, month, copySalesRange(store, month * 100 + 1, month * 100 + 31))) {
+            std::cerr << "Error: Could not partition the sales into " << directory << ".\n";
+            return false;
+        }
+    }
+    for (int month : stale) {
+        writePartition(manifest, month, SalesCopy());
+    }
+    if (!writeManifest(manifest)) {
+        return false;
+    }
+    std::remove(partitionJournalFilename(directory).c_str());
+    std::cout << "Partitioned " << store.size() << " sale(s) into " << months.size() << " monthly file(s) in "
+              << directory << ".\n";
+    return true;
+}
+
+// Function to list the months whose partitions hold dates in fromDate..toDate
+std::vector<int> overlappingPartitions(const PartitionManifest& manifest, int fromDate, int toDate) {
+    std::vector<int> months;
+    for (const auto& [month, info] : manifest.partitions) {
+        if (info.maxDate >= fromDate && info.minDate <= toDate) {
+            months.push_back(month);
+        }
+    }
+    return months;
+}
+
+// Function to load the partitions that overlap fromDate..toDate. Partitions
+// are mapped and parsed concurrently, each into its own dictionary of views
+// into its mapping, and joined in month order, so the rows come out in date
+// order. Other partitions are never opened.
+SalesStore loadPartitions(const PartitionManifest& manifest, int fromDate, int toDate, unsigned threadCount) {
+    STATS_PHASE(PhaseLoadPartitions);
+    SalesStore store;
+    std::vector<int> months = overlappingPartitions(manifest, fromDate, toDate);
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threadCount = static_cast<unsigned>(std::max<std::size_t>(1, std::min<std::size_t>(threadCount, months.size())));
+
+    std::vector<MappedFile> files(months.size());
+    std::vector<std::vector<Sale>> parts(months.size());
+    std::vector<StringDictionary> dictionaries(months.size());
+    std::vector<std::size_t> skipped(months.size(), 0);
+    std::atomic<std::size_t> next{0};
+    auto work = [&] {
+        for (std::size_t i = next++; i < months.size(); i = next++) {
+            files[i] = MappedFile(partitionFilename(manifest, months[i]));
+            if (files[i].is_open()) {
+                skipped[i] = parseSaleRows(files[i].data(), parts[i], dictionaries[i], false);
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned t = 1; t < threadCount; ++t) {
+        workers.emplace_back(work);
+    }
+    work();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    for (std::size_t i = 0; i < months.size(); ++i) {
+        std::string filename = partitionFilename(manifest, months[i]);
+        if (!files[i].is_open()) {
+            std::cerr << "Error: Could not open partition " << filename << ".\n";
+        } else if (skipped[i] > 0) {
+            std::cerr << "Warning: Skipped " << skipped[i] << " malformed row(s) in " << filename << ".\n";
+        }
+        STATS_BYTES(files[i].data().size());
+    }
+    joinSaleParts(store, parts, dictionaries);
+    STATS_ROWS(store.rows.size());
+    return store;
+}
+
+// Function to drop the sales dated outside fromDate..toDate
+void keepDateRange(SalesStore& store, int fromDate, int toDate) {
+    std::vector<int> outside;
+    for (const auto& [dateKey, saleID] : store.byDate) {
+        if (dateKey < fromDate || dateKey > toDate) {
+            outside.push_back(saleID);
+        }
+    }
+    for (int saleID : outside) {
+        eraseSale(store, saleID);
+    }
+}
+
+// Function to copy the rows, dictionary views and date order of a store
+SalesCopy copySales(const SalesStore& store) {
+    SalesCopy copy;
+    copy.rows = store.rows;
+    copy.strings = store.dictionary.strings;
+    copy.order.reserve(store.rows.size());
+    for (const auto& key : store.byDate) {
+        copy.order.push_back(static_cast<std::uint32_t>(store.index.at(key.second)));
+    }
+    return copy;
+}
+
+// Function to copy the sales dated fromDate to toDate, in date order. Only
+// the rows in the range are copied, so a short range is a short lock.
+SalesCopy copySalesRange(const SalesStore& store, int fromDate, int toDate) {
+    SalesCopy copy;
+    copy.strings = store.dictionary.strings;
+    auto first = store.byDate.lower_bound({fromDate, std::numeric_limits<int>::min()});
+    auto last = store.byDate.upper_bound({toDate, std::numeric_limits<int>::max()});
+    for (auto it = first; it != last; ++it) {
+        copy.order.push_back(static_cast<std::uint32_t>(copy.rows.size()));
+        copy.rows.push_back(store.rows[store.index.at(it->second)]);
+    }
+    return copy;
+}
+
+// Function to start the background checkpoint thread
+void startWriteBack(WriteBack& writeBack, SalesStore& store, SalesJournal& journal) {
+    writeBack.store = &store;
+    writeBack.journal = &journal;
+    writeBack.stopping = false;
+    writeBack.worker = std::thread([&writeBack] {
+        SalesJournal& journal = *writeBack.journal;
+        std::unique_lock<std::shared_mutex> lock(journal.mutex);
+        while (!writeBack.stopping) {
+            if (journal.records == 0) {
+                writeBack.wake.wait(lock);
+                continue;
+            }
+            bool due = writeBack.wake.wait_until(lock, journal.dirtySince + writeBackDelay, [&] {
+                return writeBack.stopping || journal.records >= writeBackRecords;
+            });
+            if (writeBack.stopping) {
+                break;
+            }
+            if (due || std::chrono::steady_clock::now() >= journal.dirtySince + writeBackDelay) {
+                lock.unlock();
+                bool folded = checkpointSales(*writeBack.store, journal);
+                lock.lock();
+                if (!folded && journal.records > 0) {
+                    // A failed checkpoint is retried after the usual delay
+                    writeBack.wake.wait_for(lock, writeBackDelay, [&] { return writeBack.stopping; });
+                }
+            }
+        }
+    });
+}
+
+// Function to tell the background thread that an edit was journaled
+void notifyWriteBack(WriteBack& writeBack) {
+    writeBack.wake.notify_one();
+}
+
+// Function to stop the background thread, letting a running checkpoint
+// finish. The caller does the final checkpoint.
+void stopWriteBack(WriteBack& writeBack) {
+    if (!writeBack.worker.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::shared_mutex> lock(writeBack.journal->mutex);
+        writeBack.stopping = true;
+    }
+    writeBack.wake.notify_one();
+    writeBack.worker.join();
+}
+
+// Function to checkpoint and exit when SIGTERM arrives. SIGTERM is blocked
+// in every thread and picked up here with sigwait, so the checkpoint runs as
+// ordinary code rather than inside a signal handler.
+void flushOnTerminate(SalesStore& store, SalesJournal& journal) {
+#ifndef _WIN32
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    std::thread([&store, &journal, signals] {
+        int signal = 0;
+        sigwait(&signals, &signal);
+        checkpointSales(store, journal);
+        std::_Exit(0);
+    }).detach();
+#else
+    (void)store;
+    (void)journal;
+#endif
+}
+
+// Function to generate a report straight from sales that are already in date
+// order. Subtotals are gathered per run of equal dates, so no map is needed.
+// Works on any store with size(), operator[] returning a Sale and text()
+// resolving its description and item codes.
+// The rows are handled in rounds. Each round is cut into one slice per
+// thread, and slices only end where the date changes, so every subtotal is
+// summed by one thread in row order. The grand total is the sum of the
+// subtotals in date order. The report is therefore the same for any number
+// of threads.
+template <typename Sales>
+void generateReport(const std::string& reportFilename, const Sales& sales, unsigned threadCount, const SalesAggregates* aggregates) {
+    STATS_PHASE(PhaseReport);
+    std::ofstream report(reportFilename);
+
+    if (!report.is_open()) {
+        std::cerr << "Error: Could not open report file " << reportFilename << ".\n";
+        return;
+    }
+    ReportWriter out(report);
+    writeReport(out, sales, threadCount, aggregates);
+    STATS_ROWS(sales.size());
+    STATS_BYTES(static_cast<std::size_t>(report.tellp()));
+
+    report.close();
+    std::cout << "Report generated successfully in " << reportFilename << "!\n";
+}
+
+// Function to write the report for sales in date order to a writer, which
+// may be backed by a file or only collect the text. When the sales come with
+// running aggregates, the summary is read from them instead of being summed
+// while the rows are written.
+template <typename Sales>
+void writeReport(ReportWriter& out, const Sales& sales, unsigned threadCount, const SalesAggregates* aggregates) {
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    const std::string_view rule = "----------------------------------------------------------------------------\n";
+    out.text("Sales Report : Stationary Items sold\n");
+    out.text("Date of Report : ");
+    out.text(currentDate());
+    out.text("\n");
+    out.text(rule);
+    out.text("Date", 12);
+    out.text("Sales ID", 12);
+    out.text("Item Name", 20);
+    out.text("Quantity", 10);
+    out.text("Price", 10);
+    out.text("SalesAmount", 15);
+    out.text("\n");
+    out.text(rule);
+
+    // Moves a row position forward to the start of the next run of dates
+    auto runBoundary = [&](std::size_t position) {
+        if (position == 0 || position >= sales.size()) {
+            return std::min(position, sales.size());
+        }
+        int dateKey = sales[position - 1].dateKey;
+        while (position < sales.size() && sales[position].dateKey == dateKey) {
+            ++position;
+        }
+        return position;
+    };
+
+    // Slices of about 64k rows, each cut at the start of a date
+    const std::size_t rowsPerSlice = 1 << 16;
+    std::vector<std::size_t> bounds = {0};
+    while (bounds.back() < sales.size()) {
+        bounds.push_back(runBoundary(bounds.back() + rowsPerSlice));
+    }
+    const std::size_t sliceCount = bounds.size() - 1;
+    std::vector<std::pair<int, std::int64_t>> subtotals;
+
+    if (threadCount == 1 || sliceCount <= 1) {
+        ReportWriter slice;
+        for (std::size_t k = 0; k < sliceCount; ++k) {
+            slice.buffer.clear();
+            formatReportRows(sales, bounds[k], bounds[k + 1], slice, aggregates ? nullptr : &subtotals);
+            out.block(slice.buffer);
+        }
+    } else {
+        // Worker t formats slices t, t + threadCount, ... into two rounds of
+        // buffers while this thread writes the finished slices in order, so
+        // one round is written while the next is formatted. A buffer is
+        // formatted again only once it has been written.
+        threadCount = static_cast<unsigned>(std::min<std::size_t>(threadCount, sliceCount));
+        const std::size_t slotCount = 2 * static_cast<std::size_t>(threadCount);
+        std::vector<ReportWriter> slots(slotCount);
+        std::vector<std::vector<std::pair<int, std::int64_t>>> slotSubtotals(slotCount);
+        std::vector<std::size_t> formatted(slotCount, 0); // Slice number + 1 held by each slot
+        std::size_t written = 0;
+        std::mutex mutex;
+        std::condition_variable sliceFormatted;
+        std::condition_variable sliceWritten;
+
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < threadCount; ++t) {
+            workers.emplace_back([&, t] {
+                for (std::size_t k = t; k < sliceCount; k += threadCount) {
+                    std::size_t slot = k % slotCount;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        sliceWritten.wait(lock, [&] { return k < written + slotCount; });
+                    }
+                    slots[slot].buffer.clear();
+                    slotSubtotals[slot].clear();
+                    formatReportRows(sales, bounds[k], bounds[k + 1], slots[slot],
+                                     aggregates ? nullptr : &slotSubtotals[slot]);
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        formatted[slot] = k + 1;
+                    }
+                    sliceFormatted.notify_all();
+                }
+            });
+        }
+
+        for (std::size_t k = 0; k < sliceCount; ++k) {
+            std::size_t slot = k % slotCount;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                sliceFormatted.wait(lock, [&] { return formatted[slot] == k + 1; });
+            }
+            out.block(slots[slot].buffer);
+            subtotals.insert(subtotals.end(), slotSubtotals[slot].begin(), slotSubtotals[slot].end());
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                written = k + 1;
+            }
+            sliceWritten.notify_all();
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    std::int64_t grandTotal = 0;
+    auto writeSubtotal = [&](int date, std::int64_t subtotal) {
+        out.text("Subtotal for ");
+        out.date(date, 0);
+        out.text(" is :");
+        out.money(subtotal, 10);
+        out.text("\n");
+    };
+    out.text(rule);
+    if (aggregates != nullptr) {
+        for (const auto& [date, totals] : aggregates->dates) {
+            writeSubtotal(date, totals.amount);
+        }
+        grandTotal = aggregates->total.amount;
+    } else {
+        for (const auto& [date, subtotal] : subtotals) {
+            writeSubtotal(date, subtotal);
+            grandTotal += subtotal;
+        }
+    }
+    out.text(rule);
+    out.text("Grand Total : ");
+    out.money(grandTotal, 10);
+    out.text("\n");
+    out.text(rule);
+    out.flush();
+}
+
+// Function to return today's date as YYYY-MM-DD for report headers. Reports
+// can be written by several server connections at once, so the reentrant
+// conversion is used.
+std::string currentDate() {
+    std::time_t now = std::time(nullptr);
+    std::tm local{};
+#ifdef _WIN32
+    localtime_s(&local, &now);
+#else
+    localtime_r(&now, &local);
+#endif
+    char dateBuffer[100];
+    std::strftime(dateBuffer, sizeof(dateBuffer), "%Y-%m-%d", &local);
+    return dateBuffer;
+}
+
+// Function to format report rows [begin, end) and add up their subtotals,
+// unless subtotals is null. The range must start at a new date so each run
+// is summed in one place.
+template <typename Sales>
+void formatReportRows(const Sales& sales, std::size_t begin, std::size_t end, ReportWriter& out,
+                      std::vector<std::pair<int, std::int64_t>>* subtotals) {
+    for (std::size_t i = begin; i < end; ++i) {
+        const Sale& sale = sales[i];
+        std::int64_t amount = sale.salesAmount();
+        out.date(sale.dateKey, 12);
+        out.number(sale.saleID, 12);
+        out.text(sales.text(sale.itemCode), 20);
+        out.number(sale.quantity, 10);
+        out.money(sale.unitPrice, 10);
+        out.money(amount, 15);
+        out.text("\n");
+
+        if (subtotals == nullptr) {
+            continue;
+        }
+        if (subtotals->empty() || subtotals->back().first != sale.dateKey) {
+            subtotals->emplace_back(sale.dateKey, 0);
+        }
+        subtotals->back().second += amount;
+    }
+}
+
+// Function to add up the sales amount per date and overall for sales in
+// date order. Each run of equal dates becomes one subtotal.
+template <typename Sales>
+std::int64_t accumulateTotals(const Sales& sales, std::vector<std::pair<int, std::int64_t>>& subtotals) {
+    std::int64_t grandTotal = 0;
+    for (std::size_t i = 0; i < sales.size(); ++i) {
+        const Sale& sale = sales[i];
+        if (subtotals.empty() || subtotals.back().first != sale.dateKey) {
+            subtotals.emplace_back(sale.dateKey, 0);
+        }
+        subtotals.back().second += sale.salesAmount();
+        grandTotal += sale.salesAmount();
+    }
+    return grandTotal;
+}
+
+// Columnar version: reads only the date, quantity and price columns
+std::int64_t accumulateTotals(const ColumnarSales& sales, std::vector<std::pair<int, std::int64_t>>& subtotals) {
+    std::int64_t grandTotal = 0;
+    const int* dateKeys = sales.dateKeys.data();
+    const int* quantities = sales.quantities.data();
+    const std::int64_t* unitPrices = sales.unitPrices.data();
+    for (std::size_t i = 0; i < sales.size(); ++i) {
+        std::int64_t amount = quantities[i] * unitPrices[i];
+        if (subtotals.empty() || subtotals.back().first != dateKeys[i]) {
+            subtotals.emplace_back(dateKeys[i], 0);
+        }
+        subtotals.back().second += amount;
+        grandTotal += amount;
+    }
+    return grandTotal;
+}
+
+// Function to count the days from 1970-01-01 to a packed date
+int daysFromDate(int dateKey) {
+    int year = dateKey / 10000;
+    int month = dateKey / 100 % 100;
+    int day = dateKey % 100;
+    year -= month <= 2 ? 1 : 0;
+    int era = (year >= 0 ? year : year - 399) / 400;
+    int yearOfEra = year - era * 400;
+    int dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + dayOfEra - 719468;
+}
+
+// Function to turn a count of days from 1970-01-01 back into a packed date
+int dateFromDays(int days) {
+    days += 719468;
+    int era = (days >= 0 ? days : days - 146096) / 146097;
+    int dayOfEra = days - era * 146097;
+    int yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    int dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    int shiftedMonth = (5 * dayOfYear + 2) / 153;
+    int day = dayOfYear - (153 * shiftedMonth + 2) / 5 + 1;
+    int month = shiftedMonth < 10 ? shiftedMonth + 3 : shiftedMonth - 9;
+    int year = yearOfEra + era * 400 + (month <= 2 ? 1 : 0);
+    return year * 10000 + month * 100 + day;
+}
+
+// Function to read a grouping such as "item" or "item,week". Fields are
+// date, month, week (starting Monday), item and description; at most two.
+bool parseGrouping(std::string_view spec, Grouping& grouping) {
+    grouping.fields.clear();
+    while (!spec.empty()) {
+        std::size_t comma = spec.find(',');
+        std::string_view name = spec.substr(0, comma);
+        spec.remove_prefix(comma == std::string_view::npos ? spec.size() : comma + 1);
+
+        if (name == "date") {
+            grouping.fields.push_back(GroupDate);
+        } else if (name == "month") {
+            grouping.fields.push_back(GroupMonth);
+        } else if (name == "week") {
+            grouping.fields.push_back(GroupWeek);
+        } else if (name == "item") {
+            grouping.fields.push_back(GroupItem);
+        } else if (name == "description") {
+            grouping.fields.push_back(GroupDescription);
+        } else {
+            return false;
+        }
+    }
+    return !grouping.fields.empty() && grouping.fields.size() <= 2;
+}
+
+// Function to read a list of measures such as "count,sum,avg"
+bool parseMeasures(std::string_view spec, unsigned& measures) {
+    measures = 0;
+    while (!spec.empty()) {
+        std::size_t comma = spec.find(',');
+        std::string_view name = spec.substr(0, comma);
+        spec.remove_prefix(comma == std::string_view::npos ? spec.size() : comma + 1);
+
+        if (name == "count") {
+            measures |= MeasureCount;
+        } else if (name == "sum") {
+            measures |= MeasureSum;
+        } else if (name == "min") {
+            measures |= MeasureMin;
+        } else if (name == "max") {
+            measures |= MeasureMax;
+        } else if (name == "avg") {
+            measures |= MeasureAvg;
+        } else {
+            return false;
+        }
+    }
+    return measures != 0;
+}
+
+// Function to give the part of a sale's group key for one field. Months are
+// YYYYMM and weeks the packed date of their Monday.
+std::uint32_t groupKeyPart(GroupField field, const Sale& sale) {
+    switch (field) {
+        case GroupDate:
+            return static_cast<std::uint32_t>(sale.dateKey);
+        case GroupMonth:
+            return static_cast<std::uint32_t>(sale.dateKey / 100);
+        case GroupWeek: {
+            // 1970-01-01 was a Thursday, so Monday is three days before it
+            int days = daysFromDate(sale.dateKey);
+            int sinceMonday = ((days + 3) % 7 + 7) % 7;
+            return static_cast<std::uint32_t>(dateFromDays(days - sinceMonday));
+        }
+        case GroupItem:
+            return sale.itemCode;
+        case GroupDescription:
+            return sale.descriptionCode;
+    }
+    return 0;
+}
+
+// Function to fill several groupings in a single pass over the sales
+template <typename Sales>
+void groupSales(const Sales& sales, std::vector<Grouping>& groupings) {
+    STATS_PHASE(PhaseGroup);
+    for (auto& grouping : groupings) {
+        grouping.groups.clear();
+    }
+    for (std::size_t i = 0; i < sales.size(); ++i) {
+        const Sale& sale = sales[i];
+        for (auto& grouping : groupings) {
+            std::uint64_t key = groupKeyPart(grouping.fields[0], sale);
+            if (grouping.fields.size() > 1) {
+                key = key << 32 | groupKeyPart(grouping.fields[1], sale);
+            }
+            grouping.groups[key].add(sale);
+        }
+    }
+    STATS_ROWS(sales.size());
+}
+
+// Function to write one grouping in the report layout: a column for each
+// key field, then the chosen measures, one line per group in key order and
+// a grand total line over all groups
+template <typename Sales>
+void writeGroupReport(ReportWriter& out, const Grouping& grouping, const Sales& sales, unsigned measures) {
+    static const char* const fieldNames[] = {"date", "month", "week", "item", "description"};
+    static const char* const fieldHeadings[] = {"Date", "Month", "Week of", "Item Name", "Description"};
+    static const std::size_t fieldWidths[] = {12, 10, 12, 20, 20};
+    const std::string_view rule = "----------------------------------------------------------------------------\n";
+
+    auto keyPart = [&](std::uint64_t key, std::size_t field) {
+        return static_cast<std::uint32_t>(grouping.fields.size() == 2 && field == 0 ? key >> 32 : key);
+    };
+    // Items and descriptions sort by their text, the rest by number
+    auto less = [&](std::uint64_t a, std::uint64_t b) {
+        for (std::size_t f = 0; f < grouping.fields.size(); ++f) {
+            std::uint32_t left = keyPart(a, f);
+            std::uint32_t right = keyPart(b, f);
+            if (left == right) {
+                continue;
+            }
+            GroupField field = grouping.fields[f];
+            if (field == GroupItem || field == GroupDescription) {
+                return sales.text(left) < sales.text(right);
+            }
+            return left < right;
+        }
+        return false;
+    };
+    std::vector<std::uint64_t> keys;
+    keys.reserve(grouping.groups.size());
+    for (const auto& group : grouping.groups) {
+        keys.push_back(group.first);
+    }
+    std::sort(keys.begin(), keys.end(), less);
+
+    auto writeMeasures = [&](const GroupTotals& totals) {
+        if (measures & MeasureCount) {
+            out.number(static_cast<long long>(totals.count), 10);
+        }
+        if (measures & MeasureSum) {
+            out.number(totals.quantity, 10);
+            out.money(totals.amount, 15);
+        }
+        if (measures & MeasureMin) {
+            out.number(totals.minQuantity, 10);
+            out.money(totals.minAmount, 15);
+        }
+        if (measures & MeasureMax) {
+            out.number(totals.maxQuantity, 10);
+            out.money(totals.maxAmount, 15);
+        }
+        if (measures & MeasureAvg) {
+            // Averages keep two decimals, so the quantity is shown like money
+            std::int64_t count = static_cast<std::int64_t>(std::max<std::size_t>(totals.count, 1));
+            out.money(totals.quantity * 100 / count, 10);
+            out.money(totals.amount / count, 15);
+        }
+        out.text("\n");
+    };
+
+    out.text("Sales Report : Stationary Items sold by ");
+    for (std::size_t f = 0; f < grouping.fields.size(); ++f) {
+        out.text(f == 0 ? "" : " and ");
+        out.text(fieldNames[grouping.fields[f]]);
+    }
+    out.text("\n");
+    out.text("Date of Report : ");
+    out.text(currentDate());
+    out.text("\n");
+    out.text(rule);
+    std::size_t keyWidth = 0;
+    for (GroupField field : grouping.fields) {
+        out.text(fieldHeadings[field], fieldWidths[field]);
+        keyWidth += fieldWidths[field];
+    }
+    if (measures & MeasureCount) {
+        out.text("Count", 10);
+    }
+    const std::pair<unsigned, const char*> measureNames[] = {
+        {MeasureSum, "SUM"}, {MeasureMin, "MIN"}, {MeasureMax, "MAX"}, {MeasureAvg, "AVG"}};
+    for (const auto& [measure, name] : measureNames) {
+        if (measures & measure) {
+            out.text(std::string(name) + " Qty", 10);
+            out.text(std::string(name) + " Amount", 15);
+        }
+    }
+    out.text("\n");
+    out.text(rule);
+
+    GroupTotals grandTotals;
+    for (std::uint64_t key : keys) {
+        const GroupTotals& totals = grouping.groups.at(key);
+        for (std::size_t f = 0; f < grouping.fields.size(); ++f) {
+            GroupField field = grouping.fields[f];
+            std::uint32_t part = keyPart(key, f);
+            std::size_t width = fieldWidths[field];
+            if (field == GroupDate || field == GroupWeek) {
+                out.date(static_cast<int>(part), width);
+            } else if (field == GroupMonth) {
+                char month[10];
+                formatDate(static_cast<int>(part) * 100 + 1, month);
+                out.text(std::string_view(month, 7), width);
+            } else {
+                out.text(sales.text(part), width);
+            }
+        }
+        writeMeasures(totals);
+        grandTotals.merge(totals);
+        out.flushIfFull();
+    }
+    out.text(rule);
+    out.text("Grand Total", keyWidth);
+    writeMeasures(grandTotals);
+    out.text(rule);
+}
+
+// Function to fill groupings by date or by item straight from a store's
+// running aggregates. Only works when every grouping is one of those two and
+// no measure needs MIN or MAX; returns false otherwise.
+bool groupFromAggregates(const SalesAggregates& aggregates, std::vector<Grouping>& groupings, unsigned measures) {
+    if (measures & (MeasureMin | MeasureMax)) {
+        return false;
+    }
+    for (const auto& grouping : groupings) {
+        if (grouping.fields.size() != 1 || (grouping.fields[0] != GroupDate && grouping.fields[0] != GroupItem)) {
+            return false;
+        }
+    }
+    auto fill = [](Grouping& grouping, const auto& groups) {
+        grouping.groups.clear();
+        for (const auto& [key, running] : groups) {
+            GroupTotals& totals = grouping.groups[static_cast<std::uint64_t>(key)];
+            totals.count = running.count;
+            totals.quantity = running.quantity;
+            totals.amount = running.amount;
+        }
+    };
+    for (auto& grouping : groupings) {
+        if (grouping.fields[0] == GroupDate) {
+            fill(grouping, aggregates.dates);
+        } else {
+            fill(grouping, aggregates.items);
+        }
+    }
+    return true;
+}
+
+// Function to write each grouping to the report file in turn
+template <typename Sales>
+void generateGroupReport(const std::string& reportFilename, const Sales& sales, std::vector<Grouping>& groupings, unsigned measures) {
+    std::ofstream report(reportFilename);
+    if (!report.is_open()) {
+        std::cerr << "Error: Could not open report file " << reportFilename << ".\n";
+        return;
+    }
+    ReportWriter out(report);
+    for (std::size_t g = 0; g < groupings.size(); ++g) {
+        if (g > 0) {
+            out.text("\n");
+        }
+        writeGroupReport(out, groupings[g], sales, measures);
+    }
+    out.flush();
+    report.close();
+    std::cout << "Grouped report generated successfully in " << reportFilename << "!\n";
+}
+
+// Function to write the top items by revenue and the largest single sales.
+// The sales are cut into one slice per thread; each thread keeps its own
+// bounded heap of sales and, unless running aggregates already hold them,
+// its own revenue per item. The heaps and item totals are then merged and
+// the items ranked through another bounded heap, so no list is ever sorted
+// beyond the entries that are shown.
+template <typename Sales>
+void generateLeaderboard(const std::string& reportFilename, const Sales& sales, std::size_t itemLimit,
+                         std::size_t saleLimit, unsigned threadCount, const SalesAggregates* aggregates) {
+    STATS_PHASE(PhaseLeaderboard);
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threadCount = static_cast<unsigned>(std::max<std::size_t>(1, std::min<std::size_t>(threadCount, sales.size())));
+
+    std::vector<BoundedHeap> largest(threadCount);
+    std::vector<std::unordered_map<std::uint32_t, RunningTotals>> itemTotals(threadCount);
+    auto work = [&](unsigned t) {
+        std::size_t begin = sales.size() * t / threadCount;
+        std::size_t end = sales.size() * (t + 1) / threadCount;
+        largest[t].limit = saleLimit;
+        for (std::size_t i = begin; i < end; ++i) {
+            const Sale& sale = sales[i];
+            largest[t].push(Ranked{sale.salesAmount(), sale.saleID, i});
+            if (aggregates == nullptr) {
+                itemTotals[t][sale.itemCode].add(sale, 1);
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned t = 1; t < threadCount; ++t) {
+        workers.emplace_back(work, t);
+    }
+    work(0);
+    for (auto& worker : workers) {
+        worker.join();
+    }
 
-    double salesAmount() const {
-        return quantity * unitPrice;
+    for (unsigned t = 1; t < threadCount; ++t) {
+        largest[0].merge(largest[t]);
+        for (const auto& [code, totals] : itemTotals[t]) {
+            RunningTotals& merged = itemTotals[0][code];
+            merged.count += totals.count;
+            merged.quantity += totals.quantity;
+            merged.amount += totals.amount;
+        }
+    }
+    const auto& items = aggregates ? aggregates->items : itemTotals[0];
+    BoundedHeap topItems;
+    topItems.limit = itemLimit;
+    for (const auto& [code, totals] : items) {
+        topItems.push(Ranked{totals.amount, code, 0});
     }
-};
 
-// Function prototypes
-std::vector<Sale> loadSales(const std::string& filename);
-void saveSales(const std::string& filename, const std::vector<Sale>& sales);
-void displaySales(const std::vector<Sale>& sales);
-int validateIntegerInput(const std::string& prompt);
-double validateDoubleInput(const std::string& prompt);
-void createSale(std::vector<Sale>& sales);
-void updateSale(std::vector<Sale>& sales);
-void deleteSale(std::vector<Sale>& sales);
-void sortAndSaveSales(std::vector<Sale>& sales);
-void generateReport(const std::string& reportFilename);
+    std::ofstream report(reportFilename);
+    if (!report.is_open()) {
+        std::cerr << "Error: Could not open report file " << reportFilename << ".\n";
+        return;
+    }
+    const std::string_view rule = "----------------------------------------------------------------------------\n";
+    ReportWriter out(report);
+    auto header = [&](const std::string& title) {
+        out.text("Sales Report : " + title + "\n");
+        out.text("Date of Report : ");
+        out.text(currentDate());
+        out.text("\n");
+        out.text(rule);
+        out.text("Rank", 6);
+    };
 
-// Function to validate integer input
-int validateIntegerInput(const std::string& prompt) {
-    int value;
-    while (true) {
-        std::cout << prompt;
-        std::cin >> value;
-        if (std::cin.fail() || value < 0) {
-            std::cin.clear(); // Clear the error flag
-            std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n'); // Ignore the invalid input
-            std::cerr << "Invalid input. Please enter a positive integer.\n";
-        } else {
-            std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n'); // Ignore any extra input
-            return value;
+    if (itemLimit > 0) {
+        header("Top " + std::to_string(itemLimit) + " items by revenue");
+        out.text("Item Name", 20);
+        out.text("Sales", 10);
+        out.text("Quantity", 10);
+        out.text("SalesAmount", 15);
+        out.text("\n");
+        out.text(rule);
+        std::size_t rank = 0;
+        for (const auto& entry : topItems.ranking()) {
+            const RunningTotals& totals = items.at(static_cast<std::uint32_t>(entry.id));
+            out.number(static_cast<long long>(++rank), 6);
+            out.text(sales.text(static_cast<std::uint32_t>(entry.id)), 20);
+            out.number(static_cast<long long>(totals.count), 10);
+            out.number(totals.quantity, 10);
+            out.money(totals.amount, 15);
+            out.text("\n");
+        }
+        out.text(rule);
+    }
+
+    if (saleLimit > 0) {
+        out.text(itemLimit > 0 ? "\n" : "");
+        header("Top " + std::to_string(saleLimit) + " largest sales");
+        out.text("Date", 12);
+        out.text("Sales ID", 12);
+        out.text("Item Name", 20);
+        out.text("Quantity", 10);
+        out.text("Price", 10);
+        out.text("SalesAmount", 15);
+        out.text("\n");
+        out.text(rule);
+        std::size_t rank = 0;
+        for (const auto& entry : largest[0].ranking()) {
+            const Sale& sale = sales[entry.position];
+            out.number(static_cast<long long>(++rank), 6);
+            out.date(sale.dateKey, 12);
+            out.number(sale.saleID, 12);
+            out.text(sales.text(sale.itemCode), 20);
+            out.number(sale.quantity, 10);
+            out.money(sale.unitPrice, 10);
+            out.money(entry.value, 15);
+            out.text("\n");
         }
+        out.text(rule);
     }
+    out.flush();
+    STATS_ROWS(sales.size());
+
+    report.close();
+    std::cout << "Leaderboard generated successfully in " << reportFilename << "!\n";
 }
 
-// Function to validate double input
-double validateDoubleInput(const std::string& prompt) {
-    double value;
-    while (true) {
-        std::cout << prompt;
-        std::cin >> value;
-        if (std::cin.fail() || value < 0.0) {
-            std::cin.clear(); // Clear the error flag
-            std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n'); // Ignore the invalid input
-            std::cerr << "Invalid input. Please enter a positive number.\n";
-        } else {
-            std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n'); // Ignore any extra input
-            return value;
+// Function to return the code for a string, adding it on first sight
+std::uint32_t StringDictionary::intern(std::string_view value, bool copyText) {
+    auto it = codes.find(value);
+    if (it != codes.end()) {
+        return it->second;
+    }
+    if (copyText) {
+        if (!arena) {
+            arena = std::make_unique<std::pmr::monotonic_buffer_resource>(64 * 1024);
         }
+        char* copy = static_cast<char*>(arena->allocate(value.size() == 0 ? 1 : value.size(), 1));
+        std::memcpy(copy, value.data(), value.size());
+        value = std::string_view(copy, value.size());
     }
+    std::uint32_t code = static_cast<std::uint32_t>(strings.size());
+    strings.push_back(value);
+    codes.emplace(strings.back(), code);
+    return code;
 }
 
-// Function to load sales from the CSV file into a vector
-std::vector<Sale> loadSales(const std::string& filename) {
-    std::vector<Sale> sales;
-    std::ifstream file(filename);
+// Function to append one sale to the columns
+void ColumnarSales::push_back(const Sale& sale, std::string_view description, std::string_view item) {
+    dateKeys.push_back(sale.dateKey);
+    saleIDs.push_back(sale.saleID);
+    quantities.push_back(sale.quantity);
+    unitPrices.push_back(sale.unitPrice);
+    descriptionCodes.push_back(dictionary.intern(description));
+    itemCodes.push_back(dictionary.intern(item));
+}
 
-    if (!file.is_open()) {
+// Function to copy sales from any store into a columnar store
+template <typename Sales>
+ColumnarSales toColumnar(const Sales& sales) {
+    ColumnarSales columns;
+    columns.dateKeys.reserve(sales.size());
+    columns.saleIDs.reserve(sales.size());
+    columns.quantities.reserve(sales.size());
+    columns.unitPrices.reserve(sales.size());
+    columns.descriptionCodes.reserve(sales.size());
+    columns.itemCodes.reserve(sales.size());
+    for (std::size_t i = 0; i < sales.size(); ++i) {
+        const Sale& sale = sales[i];
+        columns.push_back(sale, sales.text(sale.descriptionCode), sales.text(sale.itemCode));
+    }
+    return columns;
+}
+
+// Function to compare the stream, mapped and parallel loaders on the same file
+void benchmarkLoad(const std::string& filename, unsigned threadCount) {
+    std::ifstream probe(filename, std::ios::binary | std::ios::ate);
+    if (!probe.is_open()) {
         std::cerr << "Error: Could not open file " << filename << ".\n";
-        return sales;
+        return;
     }
+    double megabytes = static_cast<double>(probe.tellg()) / (1024.0 * 1024.0);
+    probe.close();
 
-    std::string line;
-    while (std::getline(file, line)) {
-        Sale sale;
-        std::stringstream ss(line);
-        std::string value;
+    // Each loader runs in its own child process where possible, so the peak
+    // resident size belongs to that loader alone
+    auto measure = [&](const std::string& name, auto loader) {
+#ifndef _WIN32
+        std::cout.flush();
+        pid_t child = fork();
+        if (child > 0) {
+            int status = 0;
+            waitpid(child, &status, 0);
+            return;
+        }
+#endif
+        const int runs = 3;
+        double best = std::numeric_limits<double>::max();
+        std::size_t rows = 0;
+        std::string allocations = "n/a"; // Not counted without stats
+        for (int run = 0; run < runs; ++run) {
+#ifndef SALES_NO_STATS
+            std::size_t allocationsBefore = allocationCount.load();
+#endif
+            auto start = std::chrono::steady_clock::now();
+            SalesStore store = loader(filename);
+            auto stop = std::chrono::steady_clock::now();
+#ifndef SALES_NO_STATS
+            allocations = std::to_string(allocationCount.load() - allocationsBefore);
+#endif
+            rows = store.rows.size();
+            best = std::min(best, std::chrono::duration<double>(stop - start).count());
+        }
+        std::cout << std::left << std::setw(12) << name
+                  << std::setw(12) << rows
+                  << std::setw(12) << std::fixed << std::setprecision(4) << best
+                  << std::setw(16) << std::setprecision(0) << rows / best
+                  << std::setw(12) << std::setprecision(1) << megabytes / best
+                  << std::setw(12) << allocations;
+#ifndef _WIN32
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        std::cout << std::setw(12) << std::setprecision(1) << usage.ru_maxrss / 1024.0 << "\n";
+        std::cout.flush();
+        _exit(0);
+#else
+        std::cout << std::setw(12) << "n/a" << "\n";
+#endif
+    };
+
+    std::cout << std::left
+              << std::setw(12) << "Loader"
+              << std::setw(12) << "Rows"
+              << std::setw(12) << "Seconds"
+              << std::setw(16) << "Rows/sec"
+              << std::setw(12) << "MB/sec"
+              << std::setw(12) << "Allocs"
+              << std::setw(12) << "Peak MB" << "\n";
+    measure("stream", loadSales);
+    measure("mapped", [](const std::string& name) { return loadSalesMapped(name, 1); });
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    measure("mapped x" + std::to_string(threadCount), [&](const std::string& name) {
+        return loadSalesMapped(name, threadCount);
+    });
+}
+
+// Function to time single edits against stores of growing size. The date
+// index keeps each edit O(log n); a full std::sort per edit is shown for
+// comparison.
+void benchmarkEdits() {
+    const std::size_t sizes[] = {10000, 100000, 1000000};
+    const int edits = 20000;
+
+    std::cout << std::left
+              << std::setw(12) << "Rows"
+              << std::setw(18) << "Indexed ns/edit"
+              << std::setw(18) << "Sort ms/edit" << "\n";
+
+    for (std::size_t size : sizes) {
+        SalesStore store;
+        std::mt19937 random(42);
+        std::vector<int> dates;
+        for (int month = 1; month <= 12; ++month) {
+            for (int day = 1; day <= 28; ++day) {
+                dates.push_back(20240000 + month * 100 + day);
+            }
+        }
+        std::uint32_t description = store.dictionary.intern("bench");
+        for (std::size_t i = 0; i < size; ++i) {
+            Sale sale{dates[random() % dates.size()], static_cast<int>(i), description, description, 1, 100};
+            store.rows.push_back(sale);
+        }
+        indexSales(store);
+
+        // Each round updates a date, deletes a sale and adds one back
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < edits; ++i) {
+            int saleID = static_cast<int>(random() % size);
+            Sale* found = findSale(store, saleID);
+            if (found != nullptr) {
+                Sale updated = *found;
+                updated.dateKey = dates[random() % dates.size()];
+                assignSale(store, *found, updated);
+                eraseSale(store, saleID);
+                insertSale(store, updated);
+            }
+        }
+        auto stop = std::chrono::steady_clock::now();
+        double indexedNs = std::chrono::duration<double, std::nano>(stop - start).count() / (edits * 3.0);
+
+        std::vector<Sale> copy = store.rows;
+        start = std::chrono::steady_clock::now();
+        std::sort(copy.begin(), copy.end(), [](const Sale& a, const Sale& b) {
+            return a.dateKey < b.dateKey;
+        });
+        stop = std::chrono::steady_clock::now();
+        double sortMs = std::chrono::duration<double, std::milli>(stop - start).count();
 
-        std::getline(ss, sale.date, ',');
-        std::getline(ss, value, ',');
-        sale.saleID = std::stoi(value);
-        std::getline(ss, sale.description, ',');
-        std::getline(ss, sale.item, ',');
-        std::getline(ss, value, ',');
-        sale.quantity = std::stoi(value);
-        std::getline(ss, value, ',');
-        sale.unitPrice = std::stod(value);
+        std::cout << std::left
+                  << std::setw(12) << size
+                  << std::setw(18) << std::fixed << std::setprecision(0) << indexedNs
+                  << std::setw(18) << std::setprecision(3) << sortMs << "\n";
+    }
+}
 
-        sales.push_back(sale);
+// Function to write a synthetic sales CSV. The same row count and seed give
+// the same file on every platform: numbers come straight from a 64-bit
+// Mersenne Twister instead of the implementation-defined std distributions.
+//  - Dates cover 2021-2023, with more sales at weekends and in December.
+//  - About 2000 items, a few popular and most rare, each with its own list
+//    price and a handful of descriptions.
+//  - Quantities are mostly small. About one row in 200 repeats an earlier ID.
+void generateSales(const std::string& filename, std::size_t rowCount, std::uint64_t seed) {
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Error: Could not open file " << filename << " for writing.\n";
+        return;
     }
 
-    file.close();
-    return sales;
+    std::mt19937_64 random(seed);
+    auto below = [&](std::uint64_t bound) { return random() % bound; };
+
+    const int itemCount = 2000;
+    const char* kinds[] = {"pen", "pencil", "notebook", "clip", "dress", "shirt", "cup", "lamp", "chair", "bag"};
+    const char* adjectives[] = {"blue", "large", "small", "premium", "basic", "red", "spare", "boxed"};
+    std::vector<std::string> items;
+    std::vector<std::int64_t> listPrices; // Cents
+    for (int i = 0; i < itemCount; ++i) {
+        items.push_back(std::string(kinds[i % 10]) + std::to_string(i));
+        listPrices.push_back(static_cast<std::int64_t>(50 + below(20000)));
+    }
+
+    // Days from 2021-01-01 to 2023-12-31 as date keys, each listed once per
+    // unit of weight so a uniform pick follows the weighting
+    std::vector<int> dayWeights;
+    std::tm day{};
+    day.tm_year = 121;
+    day.tm_mon = 0;
+    day.tm_mday = 1;
+    day.tm_hour = 12;
+    for (std::time_t t = std::mktime(&day); ; t += 24 * 60 * 60) {
+        std::tm current = *std::localtime(&t);
+        if (current.tm_year > 123) {
+            break;
+        }
+        int dateKey = (current.tm_year + 1900) * 10000 + (current.tm_mon + 1) * 100 + current.tm_mday;
+        int weight = 2 + (current.tm_wday == 0 || current.tm_wday == 6 ? 1 : 0) + (current.tm_mon == 11 ? 2 : 0);
+        dayWeights.insert(dayWeights.end(), weight, dateKey);
+    }
+
+    std::string buffer;
+    buffer.reserve((1 << 20) + 256);
+    char numbers[64];
+    int nextID = 1000;
+    for (std::size_t row = 0; row < rowCount; ++row) {
+        // Squaring a uniform pick skews it towards the low, popular items
+        std::uint64_t pick = below(itemCount);
+        int item = static_cast<int>(pick * pick / itemCount);
+        // About one row in 200 repeats an ID already handed out
+        int saleID = row > 0 && below(200) == 0 ? nextID - 1 - static_cast<int>(below(nextID - 1000)) : nextID++;
+        int quantity = 1 + static_cast<int>(below(4) == 0 ? below(200) : below(10));
+        std::int64_t unitPrice = listPrices[item];
+        if (below(10) == 0) {
+            unitPrice = (unitPrice * 9 + 5) / 10; // 10% off, rounded to the cent
+        }
+
+        char date[10];
+        formatDate(dayWeights[below(dayWeights.size())], date);
+        buffer.append(date, sizeof(date)).push_back(',');
+        buffer.append(numbers, std::to_chars(numbers, numbers + sizeof(numbers), saleID).ptr);
+        buffer.push_back(',');
+        buffer.append(adjectives[(item + below(3)) % 8]).push_back(' ');
+        buffer.append(kinds[item % 10]).push_back(',');
+        buffer.append(items[item]).push_back(',');
+        buffer.append(numbers, std::to_chars(numbers, numbers + sizeof(numbers), quantity).ptr);
+        buffer.push_back(',');
+        buffer.append(numbers, formatPrice(unitPrice, numbers));
+        buffer.push_back('\n');
+        if (buffer.size() >= (1 << 20)) {
+            file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            buffer.clear();
+        }
+    }
+    file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
 }
 
-// Function to save sales to a CSV file
-void saveSales(const std::string& filename, const std::vector<Sale>& sales) {
-    std::ofstream file(filename);
+// Function to time the main pipeline steps on generated files of each size
+// and print the results as JSON. Every step runs several times and the
+// median is kept, so runs on the same machine can be compared directly.
+void benchmarkPipeline(const std::vector<std::size_t>& sizes, std::uint64_t seed) {
+    const int runs = 3;
+    namespace fs = std::filesystem;
+    fs::path home = fs::current_path();
+    fs::path scratch = fs::temp_directory_path() / ("sales-bench-" + std::to_string(seed));
+    fs::create_directories(scratch);
+    fs::current_path(scratch); // temp.csv and report.txt land here
+
+    auto median = [&](auto step) {
+        std::vector<double> seconds;
+        for (int run = 0; run < runs; ++run) {
+            auto start = std::chrono::steady_clock::now();
+            step();
+            seconds.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+        std::sort(seconds.begin(), seconds.end());
+        return seconds[runs / 2];
+    };
+
+    std::cout << "{\n  \"seed\": " << seed << ",\n  \"runs\": " << runs << ",\n  \"results\": [";
+    for (std::size_t i = 0; i < sizes.size(); ++i) {
+        std::size_t size = sizes[i];
+        generateSales("input.csv", size, seed);
+
+        std::streambuf* console = std::cout.rdbuf(nullptr); // Silence the "saved" and "generated" lines
+        SalesStore store;
+        double loadSeconds = median([&] { store = loadSales("input.csv"); });
+        double loadMappedSeconds = median([&] { store = loadSalesMapped("input.csv"); });
+        double indexSeconds = median([&] { indexSales(store); });
+        double saveSeconds = median([&] { saveSales("saved.csv", store); });
+        double sortSaveSeconds = median([&] { sortAndSaveSales(store); });
+        double reportSeconds = median([&] { generateReport("report.txt", salesByDate(store)); });
+
+        // Lookups alternate between IDs that exist and IDs that do not
+        const std::size_t lookups = 1000000;
+        std::mt19937_64 random(seed);
+        std::vector<int> ids;
+        ids.reserve(lookups);
+        for (std::size_t n = 0; n < lookups; ++n) {
+            ids.push_back(n % 2 == 0 ? store.rows[random() % store.rows.size()].saleID : -1 - static_cast<int>(n));
+        }
+        std::size_t found = 0;
+        double lookupSeconds = median([&] {
+            for (int id : ids) {
+                found += findSale(store, id) != nullptr;
+            }
+        });
+        std::cout.rdbuf(console);
+
+        std::cout << (i == 0 ? "\n" : ",\n") << std::fixed << std::setprecision(6)
+                  << "    {\"rows\": " << size
+                  << ", \"loadSales_sec\": " << loadSeconds
+                  << ", \"loadSalesMapped_sec\": " << loadMappedSeconds
+                  << ", \"indexSales_sec\": " << indexSeconds
+                  << ", \"saveSales_sec\": " << saveSeconds
+                  << ", \"sortAndSaveSales_sec\": " << sortSaveSeconds
+                  << ", \"generateReport_sec\": " << reportSeconds
+                  << ", \"lookup_ns\": " << std::setprecision(1) << lookupSeconds * 1e9 / lookups
+                  << ", \"lookup_hits\": " << found / runs << "}";
+    }
+    std::cout << "\n  ]\n}\n";
+
+    fs::current_path(home);
+    std::error_code error;
+    fs::remove_all(scratch, error);
+}
+
+// Function to print the per-phase totals collected during the run
+void printStats() {
+#ifndef SALES_NO_STATS
+    std::cerr << std::left
+              << std::setw(18) << "Phase"
+              << std::setw(8) << "Calls"
+              << std::setw(14) << "Seconds"
+              << std::setw(12) << "Rows"
+              << std::setw(14) << "Bytes"
+              << std::setw(12) << "Allocs" << "\n";
+    for (int phase = 0; phase < PhaseCount; ++phase) {
+        const PhaseStats& stats = phaseStats[phase];
+        if (stats.calls == 0) {
+            continue;
+        }
+        std::cerr << std::setw(18) << phaseNames[phase]
+                  << std::setw(8) << stats.calls
+                  << std::setw(14) << std::fixed << std::setprecision(6) << stats.seconds
+                  << std::setw(12) << stats.rows
+                  << std::setw(14) << stats.bytes
+                  << std::setw(12) << stats.allocations << "\n";
+    }
+#else
+    std::cerr << "Statistics are not available in this build (SALES_NO_STATS).\n";
+#endif
+}
+
+// Function to checksum a block of bytes. Four independent lanes take eight
+// bytes each per step, so validating a large snapshot runs near memory speed.
+std::uint64_t checksumBytes(std::string_view data, std::uint64_t seed) {
+    const std::uint64_t prime = 0x9E3779B97F4A7C15ull;
+    std::uint64_t lanes[4] = {seed, seed ^ 0x5851F42D4C957F2Dull, seed + prime, seed - prime};
+    auto mix = [&](std::uint64_t lane, std::uint64_t word) {
+        lane ^= word * prime;
+        return ((lane << 31) | (lane >> 33)) * 0xC2B2AE3D27D4EB4Full;
+    };
 
+    const char* bytes = data.data();
+    std::size_t size = data.size();
+    std::size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        for (int lane = 0; lane < 4; ++lane) {
+            std::uint64_t word;
+            std::memcpy(&word, bytes + i + lane * 8, sizeof(word));
+            lanes[lane] = mix(lanes[lane], word);
+        }
+    }
+    std::uint64_t hash = mix(lanes[0], size);
+    hash = mix(hash ^ lanes[1], lanes[2]);
+    hash ^= lanes[3];
+    // The last 0 to 31 bytes, a word at a time
+    for (; i < size; i += 8) {
+        std::uint64_t tail = 0;
+        std::memcpy(&tail, bytes + i, std::min<std::size_t>(size - i, 8));
+        hash = mix(hash, tail);
+    }
+    return mix(hash, 0);
+}
+
+// Function to write the store as a binary snapshot: fixed-width columns in
+// row order, the date order permutation and the dictionary strings. Sections
+// start on 8-byte boundaries so they can be used in place once mapped.
+bool saveSnapshot(const std::string& filename, const SalesCopy& sales, const std::string& sourceFilename) {
+    AtomicFile file(filename);
     if (!file.is_open()) {
         std::cerr << "Error: Could not open file " << filename << " for writing.\n";
-        return;
+        return false;
     }
 
-    for (const auto& sale : sales) {
-        file << sale.date << "," << sale.saleID << "," << sale.description << "," 
-             << sale.item << "," << sale.quantity << "," << sale.unitPrice << "\n";
+    SnapshotHeader header{};
+    std::memcpy(header.magic, "SALESNAP", sizeof(header.magic));
+    header.version = snapshotVersion;
+    header.headerSize = sizeof(SnapshotHeader);
+    header.rowCount = sales.size();
+    header.stringCount = sales.strings.size();
+    std::error_code error;
+    header.sourceSize = std::filesystem::file_size(sourceFilename, error);
+    header.sourceTime = std::filesystem::last_write_time(sourceFilename, error).time_since_epoch().count();
+    file.write(std::string_view(reinterpret_cast<const char*>(&header), sizeof(header)));
+
+    // Every section is checksummed on its own and folded into one value
+    std::uint64_t checksum = 0;
+    auto writeSection = [&](const void* data, std::size_t bytes) {
+        static const char padding[8] = {};
+        file.write(std::string_view(static_cast<const char*>(data), bytes));
+        file.write(std::string_view(padding, (8 - bytes % 8) % 8));
+        checksum = checksumBytes(std::string_view(static_cast<const char*>(data), bytes), checksum);
+    };
+    auto writeColumn = [&](auto field) {
+        using Value = decltype(field(sales[0]));
+        std::vector<Value> column;
+        column.reserve(sales.size());
+        for (std::size_t i = 0; i < sales.size(); ++i) {
+            column.push_back(field(sales[i]));
+        }
+        writeSection(column.data(), column.size() * sizeof(Value));
+    };
+    writeColumn([](const Sale& sale) { return sale.dateKey; });
+    writeColumn([](const Sale& sale) { return sale.saleID; });
+    writeColumn([](const Sale& sale) { return sale.descriptionCode; });
+    writeColumn([](const Sale& sale) { return sale.itemCode; });
+    writeColumn([](const Sale& sale) { return sale.quantity; });
+    writeColumn([](const Sale& sale) { return sale.unitPrice; });
+
+    writeSection(sales.order.data(), sales.order.size() * sizeof(std::uint32_t));
+
+    std::vector<std::uint64_t> offsets;
+    std::string heap;
+    offsets.reserve(sales.strings.size() + 1);
+    for (auto text : sales.strings) {
+        offsets.push_back(heap.size());
+        heap.append(text);
     }
+    offsets.push_back(heap.size());
+    writeSection(offsets.data(), offsets.size() * sizeof(std::uint64_t));
+    writeSection(heap.data(), heap.size());
 
-    file.close();
+    header.heapBytes = heap.size();
+    header.checksum = checksum;
+    file.writeAt(0, std::string_view(reinterpret_cast<const char*>(&header), sizeof(header)));
+    return file.commit();
 }
 
-// Function to display sales
-void displaySales(const std::vector<Sale>& sales) {
-    for (const auto& sale : sales) {
-        std::cout << "Date: " << sale.date 
-                  << ", Sale ID: " << sale.saleID 
-                  << ", Description: " << sale.description 
-                  << ", Item: " << sale.item 
-                  << ", Quantity: " << sale.quantity 
-                  << ", Unit Price: " << sale.unitPrice 
-                  << ", Sales Amount: " << sale.salesAmount() 
-                  << "\n";
+// Function to map a snapshot and point the columns into it. Fails quietly if
+// there is no snapshot or it was written for a different version of the CSV
+// file, and with a warning if it is damaged.
+bool openSnapshot(SnapshotSales& snapshot, const std::string& filename, const std::string& sourceFilename) {
+    MappedFile file(filename);
+    if (!file.is_open()) {
+        return false;
     }
+    std::string_view data = file.data();
+
+    SnapshotHeader header;
+    if (data.size() < sizeof(header)) {
+        std::cerr << "Warning: Ignoring truncated snapshot " << filename << ".\n";
+        return false;
+    }
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (std::memcmp(header.magic, "SALESNAP", sizeof(header.magic)) != 0
+        || header.version != snapshotVersion || header.headerSize != sizeof(header)) {
+        std::cerr << "Warning: Ignoring snapshot " << filename << " with an unknown format.\n";
+        return false;
+    }
+
+    std::error_code error;
+    std::uint64_t sourceSize = std::filesystem::file_size(sourceFilename, error);
+    std::int64_t sourceTime = std::filesystem::last_write_time(sourceFilename, error).time_since_epoch().count();
+    if (error || sourceSize != header.sourceSize || sourceTime != header.sourceTime) {
+        return false; // input.csv changed since the snapshot was taken
+    }
+
+    // Work out where each section starts and check they fit the file
+    auto align = [](std::uint64_t offset) { return (offset + 7) / 8 * 8; };
+    std::uint64_t n = header.rowCount;
+    const int sections = 9;
+    std::uint64_t offsets[sections + 1];
+    offsets[0] = sizeof(header);
+    const std::uint64_t widths[sections] = {
+        4 * n, 4 * n, 4 * n, 4 * n, 4 * n, 8 * n, 4 * n, 8 * (header.stringCount + 1), header.heapBytes
+    };
+    for (int i = 0; i < sections; ++i) {
+        offsets[i + 1] = align(offsets[i] + widths[i]);
+    }
+    if (offsets[sections] != data.size()) {
+        std::cerr << "Warning: Ignoring snapshot " << filename << " with an unexpected size.\n";
+        return false;
+    }
+
+    std::uint64_t checksum = 0;
+    for (int i = 0; i < sections; ++i) {
+        checksum = checksumBytes(data.substr(offsets[i], widths[i]), checksum);
+    }
+    if (checksum != header.checksum) {
+        std::cerr << "Warning: Ignoring snapshot " << filename << " with a bad checksum.\n";
+        return false;
+    }
+
+    const char* base = data.data();
+    snapshot.rowCount = n;
+    snapshot.stringCount = header.stringCount;
+    snapshot.dateKeys = reinterpret_cast<const int*>(base + offsets[0]);
+    snapshot.saleIDs = reinterpret_cast<const int*>(base + offsets[1]);
+    snapshot.descriptionCodes = reinterpret_cast<const std::uint32_t*>(base + offsets[2]);
+    snapshot.itemCodes = reinterpret_cast<const std::uint32_t*>(base + offsets[3]);
+    snapshot.quantities = reinterpret_cast<const int*>(base + offsets[4]);
+    snapshot.unitPrices = reinterpret_cast<const std::int64_t*>(base + offsets[5]);
+    snapshot.dateOrder = reinterpret_cast<const std::uint32_t*>(base + offsets[6]);
+    snapshot.stringOffsets = reinterpret_cast<const std::uint64_t*>(base + offsets[7]);
+    snapshot.heap = base + offsets[8];
+    // Moving a MappedFile keeps the mapped address, so the pointers stay valid
+    snapshot.file = std::move(file);
+    return true;
 }
 
-// Function to add a new sale
-void createSale(std::vector<Sale>& sales) {
-    Sale newSale;
-    std::cout << "Enter sale date (YYYY-MM-DD): ";
-    std::cin >> newSale.date;
-    newSale.saleID = validateIntegerInput("Enter sale ID: ");
-    std::cout << "Enter description: ";
-    std::cin.ignore();
-    std::getline(std::cin, newSale.description);
-    std::cout << "Enter item name: ";
-    std::getline(std::cin, newSale.item);
-    newSale.quantity = validateIntegerInput("Enter quantity: ");
-    newSale.unitPrice = validateDoubleInput("Enter unit price: ");
+// Function to copy a snapshot into an editable, indexed store. Dictionary
+// codes carry over unchanged.
+SalesStore storeFromSnapshot(const SnapshotSales& snapshot) {
+    SalesStore store;
+    for (std::size_t code = 0; code < snapshot.stringCount; ++code) {
+        store.dictionary.intern(snapshot.text(static_cast<std::uint32_t>(code)));
+    }
+    store.rows.reserve(snapshot.size());
+    for (std::size_t i = 0; i < snapshot.size(); ++i) {
+        store.rows.push_back(snapshot[i]);
+    }
+    indexSales(store);
+    return store;
+}
 
-    sales.push_back(newSale);
-    saveSales("input.csv", sales);
-    sortAndSaveSales(sales);
+// Function to compare a CSV load with opening a snapshot of the same sales
+void benchmarkSnapshot(const std::string& filename) {
+    auto seconds = [](auto start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
 
-    std::cout << "Sale added successfully!\n";
+    auto start = std::chrono::steady_clock::now();
+    SalesStore store = loadSalesMapped(filename, 0);
+    indexSales(store);
+    double csvSeconds = seconds(start);
+
+    std::string snapshotFilename = filename + ".snapshot";
+    start = std::chrono::steady_clock::now();
+    saveSnapshot(snapshotFilename, copySales(store), filename);
+    double writeSeconds = seconds(start);
+
+    SnapshotSales snapshot;
+    start = std::chrono::steady_clock::now();
+    bool opened = openSnapshot(snapshot, snapshotFilename, filename);
+    double openSeconds = seconds(start);
+
+    start = std::chrono::steady_clock::now();
+    SalesStore copy = opened ? storeFromSnapshot(snapshot) : SalesStore();
+    double copySeconds = seconds(start);
+    std::remove(snapshotFilename.c_str());
+
+    std::cout << "Rows                     : " << store.rows.size() << "\n"
+              << std::fixed << std::setprecision(4)
+              << "CSV load + index (sec)   : " << csvSeconds << "\n"
+              << "Snapshot write (sec)     : " << writeSeconds << "\n"
+              << "Snapshot open (sec)      : " << openSeconds << (opened ? "" : " (failed)") << "\n"
+              << "Snapshot to store (sec)  : " << copySeconds << "\n";
 }
 
-// Function to update an existing sale
-void updateSale(std::vector<Sale>& sales) {
-    int saleID = validateIntegerInput("Enter the sale ID to update: ");
+// Function to compare memory per row and report time of the row store and
+// the columnar store over the same sales
+void benchmarkColumnar(const std::string& filename) {
+    SalesStore store = loadSalesMapped(filename, 0);
+    indexSales(store);
+    SortedSales rows = salesByDate(store);
+    ColumnarSales columns = toColumnar(rows);
+    if (rows.size() == 0) {
+        std::cerr << "Error: No sales loaded from " << filename << ".\n";
+        return;
+    }
 
-    for (auto& sale : sales) {
-        if (sale.saleID == saleID) {
-            std::cout << "Enter new sale date (YYYY-MM-DD): ";
-            std::cin >> sale.date;
-            std::cout << "Enter new description: ";
-            std::cin.ignore();
-            std::getline(std::cin, sale.description);
-            std::cout << "Enter new item name: ";
-            std::getline(std::cin, sale.item);
-            sale.quantity = validateIntegerInput("Enter new quantity: ");
-            sale.unitPrice = validateDoubleInput("Enter new unit price: ");
-
-            saveSales("input.csv", sales);
-            sortAndSaveSales(sales);
-
-            std::cout << "Sale updated successfully!\n";
-            return;
+    // Bytes per row include each layout's share of its dictionary
+    auto dictionaryBytes = [](const StringDictionary& dictionary) {
+        std::size_t bytes = 0;
+        for (auto text : dictionary.strings) {
+            bytes += text.size() + sizeof(std::string) + sizeof(std::string_view);
+        }
+        return static_cast<double>(bytes);
+    };
+    double rowBytes = sizeof(Sale) + dictionaryBytes(store.dictionary) / rows.size();
+    double columnBytes = sizeof(int) * 3 + sizeof(std::int64_t) + sizeof(std::uint32_t) * 2
+                       + dictionaryBytes(columns.dictionary) / columns.size();
+
+    // What the same text costs with an owned std::string per field
+    double ownedTextBytes = 0;
+    for (const auto& sale : store.rows) {
+        for (auto text : {store.text(sale.descriptionCode), store.text(sale.itemCode)}) {
+            ownedTextBytes += sizeof(std::string) + (text.size() > 15 ? text.size() + 1 : 0);
         }
     }
+    std::cout << "Interned " << store.dictionary.strings.size() << " distinct strings; owned strings would take "
+              << std::fixed << std::setprecision(1) << ownedTextBytes / rows.size()
+              << " bytes/row of text versus " << sizeof(std::uint32_t) * 2 << " for the codes.\n";
+
+    auto time = [](auto work) {
+        double best = std::numeric_limits<double>::max();
+        for (int run = 0; run < 3; ++run) {
+            auto start = std::chrono::steady_clock::now();
+            work();
+            auto stop = std::chrono::steady_clock::now();
+            best = std::min(best, std::chrono::duration<double>(stop - start).count());
+        }
+        return best;
+    };
+    std::vector<std::pair<int, std::int64_t>> subtotals;
+    double rowTotals = time([&] { subtotals.clear(); accumulateTotals(rows, subtotals); });
+    double columnTotals = time([&] { subtotals.clear(); accumulateTotals(columns, subtotals); });
+    std::streambuf* console = std::cout.rdbuf(nullptr); // Silence the "Report generated" lines
+    double rowReport = time([&] { generateReport("bench_report.txt", rows); });
+    double columnReport = time([&] { generateReport("bench_report.txt", columns); });
+    std::cout.rdbuf(console);
+    std::remove("bench_report.txt");
 
-    std::cerr << "Error: Sale ID not found.\n";
+    std::cout << std::left
+              << std::setw(12) << "Layout"
+              << std::setw(12) << "Bytes/row"
+              << std::setw(14) << "Totals sec"
+              << std::setw(14) << "Report sec" << "\n";
+    std::cout << std::setw(12) << "rows"
+              << std::setw(12) << std::fixed << std::setprecision(1) << rowBytes
+              << std::setw(14) << std::setprecision(4) << rowTotals
+              << std::setw(14) << rowReport << "\n";
+    std::cout << std::setw(12) << "columns"
+              << std::setw(12) << std::setprecision(1) << columnBytes
+              << std::setw(14) << std::setprecision(4) << columnTotals
+              << std::setw(14) << columnReport << "\n";
 }
 
-// Function to delete an existing sale
-void deleteSale(std::vector<Sale>& sales) {
-    int saleID = validateIntegerInput("Enter the sale ID to delete: ");
 
-    auto it = std::remove_if(sales.begin(), sales.end(), [&](const Sale& sale) {
-        return sale.saleID == saleID;
-    });
+// Function to answer one request to the query server. A request is one line:
+//   G,<saleID>                the sale as a CSV line
+//   R,<from>,<to>             the report for sales dated from..to
+//   I                         "<sales>,<first date>,<last date>,<lowest ID>,<highest ID>"
+//   C,<sale> U,<sale> D,<ID>  an edit, in the same form as a batch file line
+// The reply is "OK <bytes>" and a newline followed by that many bytes, or
+// "ERR <reason>" and a newline.
+std::string handleRequest(SalesServer& server, std::string_view request) {
+    auto reply = [](std::string_view body) {
+        std::string response = "OK " + std::to_string(body.size()) + "\n";
+        response.append(body);
+        return response;
+    };
+    auto refuse = [](std::string_view reason) {
+        return "ERR " + std::string(reason) + "\n";
+    };
 
-    if (it != sales.end()) {
-        sales.erase(it, sales.end());
-        saveSales("input.csv", sales);
-        sortAndSaveSales(sales);
+    SalesStore& store = *server.store;
+    SalesJournal& journal = *server.journal;
+    char kind = request.empty() ? '\0' : request[0];
+    std::string_view arguments = request.size() > 2 && request[1] == ',' ? request.substr(2) : std::string_view();
 
-        std::cout << "Sale deleted successfully!\n";
-    } else {
-        std::cerr << "Error: Sale ID not found.\n";
+    if (kind == 'G') {
+        int saleID;
+        const char* end = arguments.data() + arguments.size();
+        auto result = std::from_chars(arguments.data(), end, saleID);
+        if (arguments.empty() || result.ec != std::errc() || result.ptr != end) {
+            return refuse("invalid sale ID");
+        }
+        std::shared_lock<std::shared_mutex> lock(journal.mutex);
+        const Sale* sale = findSale(store, saleID);
+        if (sale == nullptr) {
+            return refuse("sale ID not found");
+        }
+        return reply(formatSaleLine(*sale, store) + "\n");
+    }
+    if (kind == 'R') {
+        std::size_t comma = arguments.find(',');
+        int fromDate, toDate;
+        if (comma == std::string_view::npos || !parseDate(arguments.substr(0, comma), fromDate)
+            || !parseDate(arguments.substr(comma + 1), toDate)) {
+            return refuse("expected R,<from date>,<to date>");
+        }
+        // Only the copy is made under the lock; edits wait for that, and
+        // other readers never wait at all
+        SalesCopy copy;
+        {
+            std::shared_lock<std::shared_mutex> lock(journal.mutex);
+            copy = copySalesRange(store, fromDate, toDate);
+        }
+        ReportWriter out;
+        writeReport(out, copy, server.threadCount);
+        return reply(out.buffer);
+    }
+    if (kind == 'I' && request.size() == 1) {
+        std::shared_lock<std::shared_mutex> lock(journal.mutex);
+        std::string body = std::to_string(store.size());
+        if (!store.byDate.empty()) {
+            auto [lowest, highest] = std::minmax_element(store.rows.begin(), store.rows.end(), [](const Sale& a, const Sale& b) {
+                return a.saleID < b.saleID;
+            });
+            body += "," + formatDate(store.byDate.begin()->first) + "," + formatDate(store.byDate.rbegin()->first)
+                + "," + std::to_string(lowest->saleID) + "," + std::to_string(highest->saleID);
+        }
+        return reply(body + "\n");
+    }
+    if (kind == 'C' || kind == 'U' || kind == 'D') {
+        std::unique_lock<std::shared_mutex> lock(journal.mutex);
+        Sale applied;
+        if (const char* reason = applyOperation(store, request, applied)) {
+            return refuse(reason);
+        }
+        appendJournal(journal, kind, applied, store);
+        lock.unlock();
+        notifyWriteBack(*server.writeBack);
+        return reply("");
     }
+    return refuse("unknown request");
 }
 
-// Function to sort sales by date and save to temp.csv
-void sortAndSaveSales(std::vector<Sale>& sales) {
-    std::sort(sales.begin(), sales.end(), [](const Sale& a, const Sale& b) {
-        return a.date < b.date;
-    });
-    saveSales("temp.csv", sales);
-    std::cout << "Sales sorted by date and saved to temp.csv.\n";
+#ifndef _WIN32
+// Function to send all of a buffer over a socket
+bool sendAll(int socket, std::string_view data) {
+    while (!data.empty()) {
+        ssize_t sent = ::send(socket, data.data(), data.size(), 0);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        data.remove_prefix(static_cast<std::size_t>(sent));
+    }
+    return true;
 }
 
-// Function to generate a report from temp.csv
-void generateReport(const std::string& reportFilename) {
-    std::vector<Sale> sales = loadSales("temp.csv");
+// Function to fill in the address of a Unix domain socket
+bool socketAddress(const std::string& socketPath, sockaddr_un& address) {
+    address = sockaddr_un{};
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Error: Socket path " << socketPath << " is too long.\n";
+        return false;
+    }
+    std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+    return true;
+}
+#endif
 
-    std::ofstream report(reportFilename);
+// Function to serve lookups, reports and edits on a Unix domain socket until
+// the process is terminated. Each connection gets its own thread and may
+// send any number of requests, one per line, each answered in turn.
+void serveSales(SalesServer& server, const std::string& socketPath) {
+#ifndef _WIN32
+    sockaddr_un address;
+    if (!socketAddress(socketPath, address)) {
+        return;
+    }
+    // A client that hangs up early must not take the server down with it
+    signal(SIGPIPE, SIG_IGN);
 
-    if (!report.is_open()) {
-        std::cerr << "Error: Could not open report file " << reportFilename << ".\n";
+    int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    struct stat info;
+    if (::lstat(socketPath.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) {
+        ::unlink(socketPath.c_str()); // Left behind by an earlier server
+    }
+    if (listener < 0 || ::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+        || ::listen(listener, SOMAXCONN) != 0) {
+        std::cerr << "Error: Could not listen on " << socketPath << ": " << std::strerror(errno) << ".\n";
+        if (listener >= 0) {
+            ::close(listener);
+        }
         return;
     }
 
-    // Get the current date and time
-    std::time_t now = std::time(nullptr);
-    char dateBuffer[100];
-    std::strftime(dateBuffer, sizeof(dateBuffer), "%Y-%m-%d", std::localtime(&now));
-
-    std::map<std::string, double> subtotals;
-    double grandTotal = 0;
-
-    report << "Sales Report : Stationary Items sold\n";
-    report << "Date of Report : " << dateBuffer << "\n";
-    report << "----------------------------------------------------------------------------\n";
-    report << std::left
-           << std::setw(12) << "Date"
-           << std::setw(12) << "Sales ID"
-           << std::setw(20) << "Item Name"
-           << std::setw(10) << "Quantity"
-           << std::setw(10) << "Price"
-           << std::setw(15) << "SalesAmount" << "\n";
-    report << "----------------------------------------------------------------------------\n";
-
-    for (const auto& sale : sales) {
-        report << std::left
-               << std::setw(12) << sale.date
-               << std::setw(12) << sale.saleID
-               << std::setw(20) << sale.item
-               << std::setw(10) << sale.quantity
-               << std::setw(10) << std::fixed << std::setprecision(2) << sale.unitPrice
-               << std::setw(15) << std::fixed << std::setprecision(2) << sale.salesAmount()
-               << "\n";
-
-        subtotals[sale.date] += sale.salesAmount();
-        grandTotal += sale.salesAmount();
+    std::cout << "Serving " << server.store->size() << " sale(s) on " << socketPath << ".\n" << std::flush;
+    while (true) {
+        int connection = ::accept(listener, nullptr, nullptr);
+        if (connection < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            std::cerr << "Error: Could not accept a connection: " << std::strerror(errno) << ".\n";
+            break;
+        }
+        std::thread(serveConnection, std::ref(server), connection).detach();
     }
+    ::close(listener);
+#else
+    (void)server;
+    std::cerr << "Error: Cannot serve on " << socketPath << ": Unix domain sockets are not supported on this platform.\n";
+#endif
+}
+
+// Function to answer the requests on one connection until the client closes it
+void serveConnection(SalesServer& server, int connection) {
+#ifndef _WIN32
+    const std::size_t maxRequestBytes = 1 << 20;
+    std::string pending;
+    std::size_t scanned = 0;
+    char chunk[64 * 1024];
+    while (true) {
+        std::size_t newline = pending.find('\n', scanned);
+        if (newline == std::string::npos) {
+            if (pending.size() > maxRequestBytes) {
+                sendAll(connection, "ERR request too long\n");
+                break;
+            }
+            scanned = pending.size();
+            ssize_t received = ::recv(connection, chunk, sizeof(chunk), 0);
+            if (received < 0 && errno == EINTR) {
+                continue;
+            }
+            if (received <= 0) {
+                break;
+            }
+            pending.append(chunk, static_cast<std::size_t>(received));
+            continue;
+        }
 
-    report << "----------------------------------------------------------------------------\n";
-    for (const auto& [date, subtotal] : subtotals) {
-        report << "Subtotal for " << date << " is :" << std::setw(10) << std::fixed << std::setprecision(2) << subtotal << "\n";
+        std::string_view request(pending.data(), newline);
+        if (!request.empty() && request.back() == '\r') {
+            request.remove_suffix(1);
+        }
+        std::string response = handleRequest(server, request);
+        pending.erase(0, newline + 1);
+        scanned = 0;
+        if (!sendAll(connection, response)) {
+            break;
+        }
     }
-    report << "----------------------------------------------------------------------------\n";
-    report << "Grand Total : " << std::setw(10) << std::fixed << std::setprecision(2) << grandTotal << "\n";
-    report << "----------------------------------------------------------------------------\n";
+    ::close(connection);
+#else
+    (void)server;
+    (void)connection;
+#endif
+}
 
-    report.close();
-    std::cout << "Report generated successfully in " << reportFilename << "!\n";
+// Function to measure the query server from several client connections at
+// once. Each client waits for every reply before sending its next request.
+// Requests are lookups of random sale IDs between the lowest and highest ID
+// the server reports, with every 50th a report for the first four weeks of
+// a random month. IDs in that range may be unused, so lookups that miss are
+// counted and timed apart from those that hit. Prints latency percentiles
+// and requests/sec.
+void loadTestServer(const std::string& socketPath, std::size_t requestCount, unsigned clientCount, std::uint64_t seed) {
+#ifndef _WIN32
+    sockaddr_un address;
+    if (!socketAddress(socketPath, address)) {
+        return;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    clientCount = std::max(1u, clientCount);
+
+    auto connectClient = [&] {
+        int client = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (client >= 0 && ::connect(client, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+            ::close(client);
+            client = -1;
+        }
+        return client;
+    };
+    // Reads one reply; the body of an OK reply ends up in body
+    auto readReply = [](int client, std::string& pending, std::string& body) {
+        char chunk[64 * 1024];
+        std::size_t needed = std::string::npos;
+        std::size_t headerEnd = 0;
+        while (true) {
+            if (needed == std::string::npos) {
+                headerEnd = pending.find('\n');
+                if (headerEnd != std::string::npos) {
+                    if (pending.compare(0, 3, "OK ") != 0) {
+                        body.clear();
+                        pending.erase(0, headerEnd + 1);
+                        return false;
+                    }
+                    needed = headerEnd + 1 + std::stoull(pending.substr(3, headerEnd - 3));
+                }
+            }
+            if (needed != std::string::npos && pending.size() >= needed) {
+                body.assign(pending, headerEnd + 1, needed - headerEnd - 1);
+                pending.erase(0, needed);
+                return true;
+            }
+            ssize_t received = ::recv(client, chunk, sizeof(chunk), 0);
+            if (received <= 0) {
+                throw std::runtime_error("connection closed");
+            }
+            pending.append(chunk, static_cast<std::size_t>(received));
+        }
+    };
+
+    int probe = connectClient();
+    if (probe < 0) {
+        std::cerr << "Error: Could not connect to " << socketPath << ".\n";
+        return;
+    }
+    std::string pending;
+    std::string info;
+    bool answered = false;
+    try {
+        answered = sendAll(probe, "I\n") && readReply(probe, pending, info);
+    } catch (const std::exception&) {
+    }
+    ::close(probe);
+    if (!answered) {
+        std::cerr << "Error: No answer from " << socketPath << ".\n";
+        return;
+    }
+    // "<sales>,<first date>,<last date>,<lowest ID>,<highest ID>", or only
+    // the count for an empty store
+    std::vector<std::string> fields;
+    std::stringstream infoFields(info);
+    for (std::string field; std::getline(infoFields, field, ',');) {
+        fields.push_back(field);
+    }
+    int firstMonth = 0, lastMonth = 0; // As year * 12 + month - 1
+    std::int64_t lowestID = 0, highestID = 0;
+    if (fields.size() == 5) {
+        int firstDate, lastDate;
+        parseDate(fields[1].substr(0, 10), firstDate);
+        parseDate(fields[2].substr(0, 10), lastDate);
+        firstMonth = firstDate / 10000 * 12 + firstDate / 100 % 100 - 1;
+        lastMonth = lastDate / 10000 * 12 + lastDate / 100 % 100 - 1;
+        lowestID = std::stoll(fields[3]);
+        highestID = std::stoll(fields[4]);
+    }
+
+    // Seconds per request, per client, lookup hits, misses and reports apart
+    std::vector<std::vector<double>> latencies(clientCount);
+    std::vector<std::vector<double>> missLatencies(clientCount);
+    std::vector<std::vector<double>> reportLatencies(clientCount);
+    std::atomic<std::size_t> failures{0};
+    auto client = [&](unsigned c) {
+        std::mt19937_64 random(seed + c);
+        std::size_t share = requestCount / clientCount + (c < requestCount % clientCount ? 1 : 0);
+        latencies[c].reserve(share);
+        int connection = connectClient();
+        if (connection < 0) {
+            failures += share;
+            return;
+        }
+        std::string pending;
+        std::string body;
+        std::string request;
+        std::size_t done = 0;
+        try {
+            for (std::size_t i = 0; i < share; ++i) {
+                bool report = i % 50 == 49 && lastMonth > 0;
+                if (report) {
+                    int month = firstMonth + static_cast<int>(random() % static_cast<std::uint64_t>(lastMonth - firstMonth + 1));
+                    int monthKey = month / 12 * 10000 + (month % 12 + 1) * 100;
+                    request = "R," + formatDate(monthKey + 1) + "," + formatDate(monthKey + 28) + "\n";
+                } else {
+                    std::uint64_t span = static_cast<std::uint64_t>(highestID - lowestID + 1);
+                    request = "G," + std::to_string(lowestID + static_cast<std::int64_t>(random() % span)) + "\n";
+                }
+                auto start = std::chrono::steady_clock::now();
+                if (!sendAll(connection, request)) {
+                    throw std::runtime_error("connection closed");
+                }
+                bool found = readReply(connection, pending, body);
+                double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                (report ? reportLatencies[c] : found ? latencies[c] : missLatencies[c]).push_back(elapsed);
+                ++done;
+            }
+        } catch (const std::exception&) {
+            failures += share - done;
+        }
+        ::close(connection);
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> clients;
+    for (unsigned c = 0; c < clientCount; ++c) {
+        clients.emplace_back(client, c);
+    }
+    for (auto& thread : clients) {
+        thread.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    auto merge = [](const std::vector<std::vector<double>>& perClient) {
+        std::vector<double> samples;
+        for (const auto& client : perClient) {
+            samples.insert(samples.end(), client.begin(), client.end());
+        }
+        std::sort(samples.begin(), samples.end());
+        return samples;
+    };
+    auto percentile = [](const std::vector<double>& samples, double p) {
+        return samples.empty() ? 0.0 : samples[std::min(samples.size() - 1, static_cast<std::size_t>(p * samples.size()))] * 1e6;
+    };
+    std::vector<double> lookups = merge(latencies);
+    std::vector<double> misses = merge(missLatencies);
+    std::vector<double> reports = merge(reportLatencies);
+    std::vector<double> all = lookups;
+    all.insert(all.end(), misses.begin(), misses.end());
+    all.insert(all.end(), reports.begin(), reports.end());
+    std::sort(all.begin(), all.end());
+
+    std::cout << "Clients             : " << clientCount << "\n"
+              << "Requests            : " << all.size() << " (" << reports.size() << " reports)\n"
+              << "Failed              : " << failures << "\n"
+              << std::fixed << std::setprecision(1)
+              << "p50 (usec)          : " << percentile(all, 0.50) << "\n"
+              << "p99 (usec)          : " << percentile(all, 0.99) << "\n"
+              << "Lookup p50 (usec)   : " << percentile(lookups, 0.50) << "\n"
+              << "Lookup p99 (usec)   : " << percentile(lookups, 0.99) << "\n"
+              << "Misses              : " << misses.size() << "\n"
+              << "Miss p50 (usec)     : " << percentile(misses, 0.50) << "\n"
+              << "Report p50 (usec)   : " << percentile(reports, 0.50) << "\n"
+              << "Report p99 (usec)   : " << percentile(reports, 0.99) << "\n"
+              << std::setprecision(0)
+              << "Requests/sec        : " << (seconds > 0 ? all.size() / seconds : 0.0) << "\n";
+#else
+    (void)requestCount;
+    (void)clientCount;
+    (void)seed;
+    std::cerr << "Error: Cannot connect to " << socketPath << ": Unix domain sockets are not supported on this platform.\n";
+#endif
 }
 
+int main(int argc, char* argv[]) {
+    bool useMappedLoader = false;
+    bool useSnapshot = true;
+    unsigned threadCount = 1;
+    std::string benchFile;
+    std::string batchFile;
+    std::string serveSocket;
+    std::string queryReport;
+    std::string partitionTarget;
+    std::string partitionDirectory;
+    SalesQuery query;
+    std::vector<Grouping> groupings;
+    bool verifyMode = false;
+    std::size_t topItems = 0;
+    std::size_t topSales = 0;
+    unsigned measures = MeasureCount | MeasureSum;
+    std::uint64_t seed = 42;
+    bool showStats = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--mmap") {
+            useMappedLoader = true;
+        } else if (arg == "--threads" && i + 1 < argc) {
+            // 0 means one thread per hardware core
+            threadCount = static_cast<unsigned>(std::stoul(argv[++i]));
+            useMappedLoader = true;
+        } else if (arg == "--bench-load" && i + 1 < argc) {
+            benchFile = argv[++i];
+        } else if (arg == "--bench-edits") {
+            benchmarkEdits();
+            return 0;
+        } else if (arg == "--bench-columnar" && i + 1 < argc) {
+            benchmarkColumnar(argv[++i]);
+            return 0;
+        } else if (arg == "--bench-snapshot" && i + 1 < argc) {
+            benchmarkSnapshot(argv[++i]);
+            return 0;
+        } else if (arg == "--sort-external" && i + 1 < argc) {
+            // Sorts input.csv into temp.csv using at most the given MiB per run
+            std::size_t budget = std::stoull(argv[++i]) * 1024 * 1024;
+            if (journalPending("input.journal")) {
+                std::cerr << "Warning: Edits in input.journal are not in input.csv yet and will not be sorted.\n";
+            }
+            return sortSalesExternal("input.csv", "temp.csv", std::max<std::size_t>(budget, 1)) ? 0 : 1;
+        } else if (arg == "--no-snapshot") {
+            useSnapshot = false;
+        } else if (arg == "--stats") {
+            showStats = true;
+        } else if (arg == "--batch" && i + 1 < argc) {
+            batchFile = argv[++i];
+        } else if (arg == "--query" && i + 1 < argc) {
+            // Writes the report for the sales picked by --from, --to,
+            // --item and --min-amount without loading the store
+            queryReport = argv[++i];
+        } else if ((arg == "--from" || arg == "--to") && i + 1 < argc) {
+            int& bound = arg == "--from" ? query.fromDate : query.toDate;
+            if (!parseDate(argv[++i], bound)) {
+                std::cerr << "Error: Invalid date " << argv[i] << " for " << arg << ".\n";
+                return 1;
+            }
+        } else if (arg == "--item" && i + 1 < argc) {
+            query.item = argv[++i];
+        } else if (arg == "--min-amount" && i + 1 < argc) {
+            if (!parsePrice(argv[++i], query.minAmount)) {
+                std::cerr << "Error: Invalid amount " << argv[i] << " for --min-amount.\n";
+                return 1;
+            }
+        } else if (arg == "--group-by" && i + 1 < argc) {
+            // May be given several times; all groupings come from one scan
+            Grouping grouping;
+            if (!parseGrouping(argv[++i], grouping)) {
+                std::cerr << "Error: Invalid grouping " << argv[i]
+                          << ". Use one or two of date, month, week, item and description.\n";
+                return 1;
+            }
+            groupings.push_back(std::move(grouping));
+        } else if (arg == "--measures" && i + 1 < argc) {
+            if (!parseMeasures(argv[++i], measures)) {
+                std::cerr << "Error: Invalid measures " << argv[i] << ". Use count, sum, min, max and avg.\n";
+                return 1;
+            }
+        } else if (arg == "--leaderboard" && i + 2 < argc) {
+            // Number of items by revenue and of single sales to list
+            topItems = std::stoull(argv[i + 1]);
+            topSales = std::stoull(argv[i + 2]);
+            i += 2;
+        } else if (arg == "--verify-aggregates") {
+            verifyMode = true;
+        } else if (arg == "--partition" && i + 1 < argc) {
+            // Writes the loaded sales to one file per month in the directory
+            partitionTarget = argv[++i];
+        } else if (arg == "--partitioned" && i + 1 < argc) {
+            // Keeps the sales in the monthly files of the directory in place
+            // of input.csv, temp.csv and the snapshot
+            partitionDirectory = argv[++i];
+            useSnapshot = false;
+        } else if (arg == "--serve" && i + 1 < argc) {
+            serveSocket = argv[++i];
+        } else if (arg == "--load-test" && i + 3 < argc) {
+            // Socket, total requests and client connections
+            loadTestServer(argv[i + 1], std::stoull(argv[i + 2]), static_cast<unsigned>(std::stoul(argv[i + 3])), seed);
+            return 0;
+        } else if (arg == "--generate" && i + 2 < argc) {
+            std::size_t rows = std::stoull(argv[i + 1]);
+            generateSales(argv[i + 2], rows, seed);
+            return 0;
+        } else if (arg == "--seed" && i + 1 < argc) {
+            seed = std::stoull(argv[++i]);
+        } else if (arg == "--bench-pipeline") {
+            // Optional comma separated sizes, e.g. --bench-pipeline 10000,100000
+            std::vector<std::size_t> sizes = {10000, 100000, 1000000};
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                sizes.clear();
+                std::stringstream list(argv[++i]);
+                std::string size;
+                while (std::getline(list, size, ',')) {
+                    sizes.push_back(std::stoull(size));
+                }
+            }
+            benchmarkPipeline(sizes, seed);
+            return 0;
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--mmap] [--threads <n>] [--no-snapshot] [--stats] [--batch <file>] [--serve <socket>]"
+                      << " [--query <report> [--from <date>] [--to <date>] [--item <name>] [--min-amount <amount>]]"
+                      << " [--group-by <fields>]... [--measures <list>] [--verify-aggregates]"
+                      << " [--leaderboard <items> <sales>] [--partition <dir>] [--partitioned <dir>]"
+                      << " [--seed <n>] [--generate <rows> <file>] [--sort-external <MiB>] [--bench-pipeline [sizes]]"
+                      << " [--bench-load <file>] [--bench-edits] [--bench-columnar <file>] [--bench-snapshot <file>]"
+                      << " [--load-test <socket> <requests> <clients>]\n";
+            return 1;
+        }
+    }
+
+    if (!benchFile.empty()) {
+        benchmarkLoad(benchFile, threadCount == 1 ? 0 : threadCount);
+        return 0;
+    }
+
+    PartitionManifest partitions;
+    std::string journalFilename = "input.journal";
+    if (!partitionDirectory.empty()) {
+        if (!readManifest(partitions, partitionDirectory)) {
+            std::cerr << "Error: No manifest in " << partitionDirectory << ". Create one with --partition "
+                      << partitionDirectory << ".\n";
+            return 1;
+        }
+        journalFilename = partitionJournalFilename(partitionDirectory);
+    }
+    // --from and --to also narrow the read-only reports; a partitioned store
+    // then loads only the months in range, so it must not be edited
+    bool dateRange = query.fromDate != SalesQuery().fromDate || query.toDate != SalesQuery().toDate;
+    bool readOnly = topItems > 0 || topSales > 0 || !groupings.empty();
+    if (dateRange && queryReport.empty() && !readOnly) {
+        std::cerr << "Error: --from and --to only apply to --query, --group-by and --leaderboard.\n";
+        return 1;
+    }
+
+    if (!queryReport.empty()) {
+        std::vector<std::string> files = {"input.csv"};
+        if (!partitionDirectory.empty()) {
+            // Partitions outside the date range are never opened
+            files.clear();
+            for (int month : overlappingPartitions(partitions, query.fromDate, query.toDate)) {
+                files.push_back(partitionFilename(partitions, month));
+            }
+        }
+        if (journalPending(journalFilename)) {
+            std::cerr << "Warning: Edits in " << journalFilename << " are not in the sales files yet and will not be queried.\n";
+        }
+        querySales(files, !partitionDirectory.empty(), query, queryReport, threadCount);
+        if (showStats) {
+            printStats();
+        }
+        return 0;
+    }
+
+    // A snapshot that matches input.csv is used in place for display and
+    // reports; it is only copied into an indexed store once an edit needs one
+    SnapshotSales snapshot;
+    SalesStore store;
+    bool onSnapshot = useSnapshot && openSnapshot(snapshot, "input.snapshot", "input.csv");
+    bool snapshotCurrent = onSnapshot; // The snapshot matched input.csv at startup
+    if (!partitionDirectory.empty()) {
+        // Partitions load in parallel, one thread per core unless --threads says otherwise
+        unsigned loadThreads = threadCount == 1 ? 0 : threadCount;
+        store = dateRange ? loadPartitions(partitions, query.fromDate, query.toDate, loadThreads)
+                          : loadPartitions(partitions, 0, SalesQuery().toDate, loadThreads);
+        indexSales(store);
+    } else if (!onSnapshot) {
+        store = useMappedLoader ? loadSalesMapped("input.csv", threadCount) : loadSales("input.csv");
+        indexSales(store);
+    }
+    auto editableStore = [&]() -> SalesStore& {
+        if (onSnapshot) {
+            store = storeFromSnapshot(snapshot);
+            snapshot = SnapshotSales();
+            onSnapshot = false;
+        }
+        return store;
+    };
+
+    SalesJournal journal;
+    if (journalPending(journalFilename)) {
+        std::size_t replayed = replayJournal(editableStore(), journalFilename);
+        if (replayed > 0) {
+            std::cout << "Replayed " << replayed << " journal record(s) from the last session.\n";
+            journal.records = replayed;
+        }
+    }
+    if (dateRange) {
+        keepDateRange(editableStore(), query.fromDate, query.toDate);
+    }
+    if (!partitionTarget.empty()) {
+        // The loaded sales, journal included, become the partitions
+        return partitionSales(editableStore(), partitionTarget) ? 0 : 1;
+    }
+    if (verifyMode) {
+        // Checks the loaded totals, then again after random edits in memory
+        SalesStore& checked = editableStore();
+        bool matched = verifyAggregates(checked) && exerciseAggregates(checked, 100000, seed);
+        return matched ? 0 : 1;
+    }
+    if (topItems > 0 || topSales > 0) {
+        // Written to leaderboard.txt from the loaded sales, journal included
+        if (onSnapshot) {
+            generateLeaderboard("leaderboard.txt", snapshot, topItems, topSales, threadCount);
+        } else {
+            generateLeaderboard("leaderboard.txt", store, topItems, topSales, threadCount, &store.aggregates);
+        }
+        if (showStats) {
+            printStats();
+        }
+        return 0;
+    }
+    if (!groupings.empty()) {
+        // Written to groups.txt from the loaded sales, journal included
+        if (onSnapshot) {
+            groupSales(snapshot, groupings);
+            generateGroupReport("groups.txt", snapshot, groupings, measures);
+        } else {
+            if (!groupFromAggregates(store.aggregates, groupings, measures)) {
+                groupSales(store, groupings);
+            }
+            generateGroupReport("groups.txt", store, groupings, measures);
+        }
+        if (showStats) {
+            printStats();
+        }
+        return 0;
+    }
+    if (!partitionDirectory.empty()) {
+        journal.partitions = &partitions;
+    }
+    openJournal(journal, journalFilename);
+
+    if (!batchFile.empty()) {
+        runBatch(editableStore(), journal, batchFile);
+        if (showStats) {
+            printStats();
+        }
+        return 0;
+    }
+
+    // Blocks SIGTERM before any other thread starts, so only the waiting
+    // thread receives it
+    if (!serveSocket.empty()) {
+        editableStore();
+    }
+    flushOnTerminate(store, journal);
+    WriteBack writeBack;
+    startWriteBack(writeBack, store, journal);
 
-int main() {
-    std::vector<Sale> sales = loadSales("input.csv");
+    if (!serveSocket.empty()) {
+        // Only returns if the socket could not be set up; SIGTERM stops a
+        // running server through flushOnTerminate
+        SalesServer server{&store, &journal, &writeBack, threadCount};
+        serveSales(server, serveSocket);
+        stopWriteBack(writeBack);
+        checkpointSales(store, journal);
+        return 1;
+    }
 
     int choice;
     do {
@@ -282,21 +4728,38 @@ int main() {
 
         switch (choice) {
             case 1:
-                displaySales(sales);
+                if (onSnapshot) {
+                    displaySales(snapshot);
+                } else {
+                    displaySales(store);
+                }
                 break;
             case 2:
-                createSale(sales);
+                createSale(editableStore(), journal);
+                notifyWriteBack(writeBack);
                 break;
             case 3:
-                updateSale(sales);
+                updateSale(editableStore(), journal);
+                notifyWriteBack(writeBack);
                 break;
             case 4:
-                deleteSale(sales);
+                deleteSale(editableStore(), journal);
+                notifyWriteBack(writeBack);
                 break;
             case 5:
-                generateReport("report.txt");
+                if (onSnapshot) {
+                    generateReport("report.txt", SnapshotByDate{&snapshot}, threadCount);
+                } else {
+                    generateReport("report.txt", salesByDate(store), threadCount, &store.aggregates);
+                }
                 break;
             case 6:
+                stopWriteBack(writeBack);
+                checkpointSales(store, journal);
+                if (!snapshotCurrent && journal.checkpoints == 0 && journal.records == 0
+                    && journal.partitions == nullptr) {
+                    saveSnapshot("input.snapshot", copySales(store), "input.csv");
+                }
                 std::cout << "Exiting program.\n";
                 break;
             default:
@@ -304,5 +4767,9 @@ int main() {
         }
     } while (choice != 6);
 
+    if (showStats) {
+        printStats();
+    }
+
     return 0;
 }